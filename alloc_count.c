@@ -0,0 +1,43 @@
+#include "alloc_count.h"
+#include <stdlib.h>
+
+#ifdef __GLIBC__
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void* __libc_memalign(size_t align, size_t size);
+
+static long allocs;
+
+void* malloc(size_t size){
+	allocs++;
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size){
+	allocs++;
+	return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size){
+	allocs++;
+	return __libc_realloc(ptr, size);
+}
+
+void* aligned_alloc(size_t align, size_t size){
+	allocs++;
+	return __libc_memalign(align, size);
+}
+
+long alloc_count(){
+	return allocs;
+}
+
+#else
+
+long alloc_count(){
+	return -1;
+}
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef __ALLOC_COUNT_H__
+#define __ALLOC_COUNT_H__
+
+/* Counts heap allocations made by the whole process, including those made
+   inside the C library, by standing in for malloc(), calloc(), realloc()
+   and aligned_alloc(). Linking alloc_count.o is enough to turn it on.
+   Only glibc is supported; elsewhere alloc_count() returns -1. */
+
+long alloc_count();
+
+#endif
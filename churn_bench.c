@@ -0,0 +1,850 @@
+/*
+ * churn_bench.c
+ *
+ * Runs a whole network of routers in one process on a simulated clock and
+ * keeps changing link costs and failing links while it runs. A failed link
+ * comes back up after a random down time.
+ * Every router is the real router core; only the wires are simulated. Each
+ * packet takes a fixed delay to cross a link and a router is busy for as
+ * long as it actually spent on the CPU handling each event, so slow route
+ * computation shows up as slow convergence.
+ *
+ * Reports per router CPU time, LSPs received and flooded and route
+ * computations, and for every change how long it took until the last
+ * routing table it affected had been updated.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "vector.h"
+#include "hashmap.h"
+#include "pool.h"
+#include "lsp.h"
+#include "router.h"
+
+#define USAGE "[-n routers] [-k links per router] [-A areas] [-t seconds] [-r changes per second]\n" \
+	"\t[-a fixed|poisson|burst] [-x fail fraction] [-D mean down seconds]\n" \
+	"\t[-o fixed|exponential|uniform] [-h hot links] [-d link delay ms]\n" \
+	"\t[-s seed] [-m] [-v] [initialization file]"
+#define DEFAULT_ROUTERS 64
+#define DEFAULT_DEGREE 4
+#define DEFAULT_DURATION 30.0
+#define DEFAULT_RATE 10.0
+#define DEFAULT_FAIL_FRACTION 0.5
+#define DEFAULT_DOWN_TIME 1.0
+#define DEFAULT_DELAY_MS 1.0
+#define MAX_COST 10
+#define CHURN_START 1.0   // Seconds the network gets to converge before changes start
+#define TIMER_INTERVAL 1.0  // Seconds between refresh and aging checks, as in routed_LS
+#define BURST_SIZE 8      // Changes per burst in burst mode
+#define BURST_GAP 0.01    // Seconds between the changes of a burst
+#define PACKETS_PER_SLAB 256
+
+/* Simulation events */
+#define SIM_DELIVER 0  // A packet arrives at a router
+#define SIM_TIMER 1    // A router checks its LSP refresh and LSDB age
+#define SIM_CHURN 2    // A link changes
+#define SIM_RESTORE 3  // A failed link comes back up
+
+/* Kinds of change */
+#define CHURN_COST 0
+#define CHURN_FAIL 1
+#define CHURN_RESTORE 2
+
+/* How far apart changes are */
+#define GAP_FIXED 0
+#define GAP_POISSON 1
+#define GAP_BURST 2
+
+/* How long failed links stay down */
+#define DOWN_FIXED 0
+#define DOWN_EXPONENTIAL 1
+#define DOWN_UNIFORM 2
+
+typedef struct {
+	char id[MAX_ID_LEN];
+	router_t router;
+	int *peers;              // Router number of each neighbor, -1 if unknown
+	double busy_until;       // Simulated time the router is free again
+	double cpu;              // Seconds spent handling events
+	unsigned long flooded;   // LSP copies sent
+} sim_router_t;
+
+typedef struct {
+	int a;
+	int b;
+} sim_link_t;
+
+typedef struct {
+	double time;
+	unsigned long seq;  // Keeps events at the same time in order
+	int type;
+	int router;
+	int link;  // Link a SIM_RESTORE brings back up
+	int tag;   // Change the packet descends from, -1 for none
+	lsp_packet_t *packet;
+} sim_event_t;
+
+typedef struct {
+	double time;
+	int kind;
+	double last_change;  // Last routing table update it caused, 0 if none
+	double last_flood;   // Last time one of its packets was handled
+} sim_change_t;
+
+typedef struct {
+	sim_router_t *routers;
+	int num_routers;
+	sim_link_t *links;
+	int num_links;
+	sim_event_t *heap;
+	int heap_len;
+	int heap_cap;
+	unsigned long seq;
+	pool_p packets;
+	vector_p members;  // Every router's areas, as every router reads them
+	sim_change_t *changes;
+	int num_changes;
+	int changes_cap;
+	double delay;
+	double down_time;  // Mean seconds a failed link stays down
+	int down_dist;
+	time_t base;  // Wall clock time the simulation starts at
+	FILE *logfp;
+} sim_t;
+
+double cpu_sec() {
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double random_unit() {
+	return rand() / (RAND_MAX + 1.0);
+}
+
+void sim_push(sim_t *s, sim_event_t ev) {
+	int i;
+	if (s->heap_len == s->heap_cap) {
+		s->heap_cap = s->heap_cap > 0 ? s->heap_cap * 2 : 1024;
+		s->heap = realloc(s->heap, s->heap_cap * sizeof(sim_event_t));
+	}
+	ev.seq = s->seq++;
+	i = s->heap_len++;
+	while (i > 0) {
+		sim_event_t *parent = &s->heap[(i - 1) / 2];
+		if (parent->time < ev.time || (parent->time == ev.time && parent->seq < ev.seq)) {
+			break;
+		}
+		s->heap[i] = *parent;
+		i = (i - 1) / 2;
+	}
+	s->heap[i] = ev;
+}
+
+sim_event_t sim_pop(sim_t *s) {
+	sim_event_t top = s->heap[0];
+	sim_event_t last = s->heap[--s->heap_len];
+	int i = 0;
+	for (;;) {
+		int child = 2 * i + 1;
+		if (child >= s->heap_len) {
+			break;
+		}
+		if (child + 1 < s->heap_len && (s->heap[child + 1].time < s->heap[child].time ||
+				(s->heap[child + 1].time == s->heap[child].time && s->heap[child + 1].seq < s->heap[child].seq))) {
+			++child;
+		}
+		if (last.time < s->heap[child].time || (last.time == s->heap[child].time && last.seq < s->heap[child].seq)) {
+			break;
+		}
+		s->heap[i] = s->heap[child];
+		i = child;
+	}
+	s->heap[i] = last;
+	return top;
+}
+
+int router_number(hashmap_p index, char *id) {
+	int *n = hashmap_get(index, id);
+	return n == NULL ? -1 : *n;
+}
+
+/* Adds a router named id, or returns the number it already has */
+int add_router(sim_t *s, hashmap_p index, char *id) {
+	sim_router_t *sr;
+	int n = router_number(index, id);
+	if (n >= 0) {
+		return n;
+	}
+	n = s->num_routers++;
+	s->routers = realloc(s->routers, s->num_routers * sizeof(sim_router_t));
+	sr = &s->routers[n];
+	memset(sr, '\0', sizeof(sim_router_t));
+	strncpy(sr->id, id, MAX_ID_LEN - 1);
+	sr->router.neighbors = create_vector();
+	sr->router.link_areas = create_vector();
+	create_tables(&sr->router);
+	hashmap_put(index, sr->id, &n, sizeof(int));
+	return n;
+}
+
+/* Loads every router in the initialization file with its links */
+int load_topology(sim_t *s, hashmap_p index, char *filename) {
+	FILE *fp = fopen(filename, "r");
+	char *line = NULL;
+	size_t len = 0;
+	int i;
+
+	if (fp == NULL) {
+		perror("fopen");
+		return -1;
+	}
+	while (getline(&line, &len, fp) != -1) {
+		char *str = strtok(line, " ,<>\n");
+		if (str != NULL) {
+			add_router(s, index, str);
+		}
+	}
+	free(line);
+
+	for (i = 0; i < s->num_routers; ++i) {
+		rewind(fp);
+		router_t *r = &s->routers[i].router;
+		init_router(fp, s->routers[i].id, r->neighbors, r->routing_table, r->link_areas, NULL);
+	}
+	fclose(fp);
+	return 0;
+}
+
+void add_link(sim_t *s, int a, int b, int cost, int area, int *next_port) {
+	table_entry_t entry;
+	int port_a = (*next_port)++;
+	int port_b = (*next_port)++;
+
+	memset(&entry, '\0', sizeof(entry));
+	snprintf(entry.dest_id, MAX_ID_LEN, "%s", s->routers[b].id);
+	entry.cost = cost;
+	entry.out_port = port_a;
+	entry.dest_port = port_b;
+	vector_add(s->routers[a].router.neighbors, &entry, sizeof(entry));
+	vector_add(s->routers[a].router.routing_table, &entry, sizeof(entry));
+	vector_add(s->routers[a].router.link_areas, &area, sizeof(area));
+
+	snprintf(entry.dest_id, MAX_ID_LEN, "%s", s->routers[a].id);
+	entry.out_port = port_b;
+	entry.dest_port = port_a;
+	vector_add(s->routers[b].router.neighbors, &entry, sizeof(entry));
+	vector_add(s->routers[b].router.routing_table, &entry, sizeof(entry));
+	vector_add(s->routers[b].router.link_areas, &area, sizeof(area));
+}
+
+/* Builds n routers split evenly into areas. The routers of each area form
+   a ring with extra random links so every router has about degree links.
+   With more than one area, the first two routers of each are also border
+   routers, joined to those of the next area and to degree / 2 random other
+   border routers by backbone links. The random ones keep the backbone's
+   diameter within the TTL however many areas there are. */
+void build_topology(sim_t *s, hashmap_p index, int n, int degree, int areas) {
+	char id[MAX_ID_LEN];
+	int next_port = 10000;
+	int a;
+	int i;
+	int k;
+
+	for (i = 0; i < n; ++i) {
+		snprintf(id, sizeof(id), "R%d", i);
+		add_router(s, index, id);
+	}
+	for (a = 0; a < areas; ++a) {
+		int lo = a * n / areas;
+		int size = (a + 1) * n / areas - lo;
+		int area = areas > 1 ? a + 1 : BACKBONE_AREA;
+		for (i = 0; i < size; ++i) {
+			for (k = 0; k < degree / 2; ++k) {
+				int j = k == 0 ? (i + 1) % size : rand() % size;
+				if (j == i || table_contains(s->routers[lo + i].router.neighbors, s->routers[lo + j].id)) {
+					continue;
+				}
+				add_link(s, lo + i, lo + j, 1 + rand() % MAX_COST, area, &next_port);
+			}
+		}
+	}
+	for (a = 0; a < areas && areas > 1; ++a) {
+		int lo = a * n / areas;
+		for (i = 0; i < 2; ++i) {
+			for (k = 0; k <= degree / 2; ++k) {
+				int other = k == 0 ? (a + 1) % areas : rand() % areas;
+				int j = other * n / areas + (k == 0 ? i : rand() % 2);
+				if (other == a || table_contains(s->routers[lo + i].router.neighbors, s->routers[j].id)) {
+					continue;
+				}
+				add_link(s, lo + i, j, 1 + rand() % MAX_COST, BACKBONE_AREA, &next_port);
+			}
+		}
+	}
+}
+
+/* Numbers every router's neighbors and lists each link once, in random
+   order so that the first few make a random set of hot links */
+void index_links(sim_t *s, hashmap_p index) {
+	int i;
+	unsigned int k;
+
+	for (i = 0; i < s->num_routers; ++i) {
+		vector_p neighbors = s->routers[i].router.neighbors;
+		s->routers[i].peers = malloc(neighbors->length * sizeof(int));
+		for (k = 0; k < neighbors->length; ++k) {
+			table_entry_t *entry = vector_get(neighbors, k);
+			int j = router_number(index, entry->dest_id);
+			s->routers[i].peers[k] = j;
+			if (j > i && table_contains(s->routers[j].router.neighbors, s->routers[i].id)) {
+				s->links = realloc(s->links, (s->num_links + 1) * sizeof(sim_link_t));
+				s->links[s->num_links].a = i;
+				s->links[s->num_links].b = j;
+				s->num_links++;
+			}
+		}
+	}
+	for (i = s->num_links - 1; i > 0; --i) {
+		int j = rand() % (i + 1);
+		sim_link_t tmp = s->links[i];
+		s->links[i] = s->links[j];
+		s->links[j] = tmp;
+	}
+}
+
+/* Sends packet from router n to every neighbor except ignore_id over links
+   that are up, arriving after the link delay */
+void flood(sim_t *s, int n, lsp_packet_t *packet, char *ignore_id, double when, int tag) {
+	sim_router_t *sr = &s->routers[n];
+	unsigned int k;
+
+	for (k = 0; k < sr->router.neighbors->length; ++k) {
+		table_entry_t *entry = vector_get(sr->router.neighbors, k);
+		sim_event_t ev;
+		if (sr->peers[k] < 0 || !link_floods(&sr->router, k, packet)) {
+			continue;
+		}
+		if (ignore_id != NULL && strncmp(entry->dest_id, ignore_id, MAX_ID_LEN) == 0) {
+			continue;
+		}
+		ev.time = when + s->delay;
+		ev.type = SIM_DELIVER;
+		ev.router = sr->peers[k];
+		ev.tag = tag;
+		ev.packet = pool_get(s->packets);
+		memcpy(ev.packet, packet, packet->header.length);
+		sim_push(s, ev);
+		sr->flooded++;
+	}
+}
+
+/* Sends whatever of router n's own LSP is due */
+void send_own_lsp(sim_t *s, int n, double when, int tag) {
+	lsp_packet_t *packet;
+	while ((packet = refresh_lsp(&s->routers[n].router, s->base + (time_t) when)) != NULL) {
+		flood(s, n, packet, NULL, when, tag);
+	}
+}
+
+/* Credits a routing table update at router n to change tag */
+void note_change(sim_t *s, int tag, double when, int changed) {
+	sim_change_t *c;
+	if (tag < 0) {
+		return;
+	}
+	c = &s->changes[tag];
+	if (changed && when > c->last_change) {
+		c->last_change = when;
+	}
+	if (when > c->last_flood) {
+		c->last_flood = when;
+	}
+}
+
+/* Applies a change to one end of a link. Returns when the router is done. */
+double change_end(sim_t *s, int n, int peer, int kind, int cost, double when, int tag) {
+	sim_router_t *sr = &s->routers[n];
+	vector_p before = sr->router.routing_table;
+	double start = when > sr->busy_until ? when : sr->busy_until;
+	double cpu = cpu_sec();
+	double done;
+
+	if (kind == CHURN_COST) {
+		set_link_cost(&sr->router, s->routers[peer].id, cost);
+	} else {
+		set_link_state(&sr->router, s->routers[peer].id, kind == CHURN_RESTORE);
+	}
+	cpu = cpu_sec() - cpu;
+	sr->cpu += cpu;
+	done = start + cpu;
+	sr->busy_until = done;
+	note_change(s, tag, done, sr->router.routing_table != before);
+	send_own_lsp(s, n, done, tag);
+	return done;
+}
+
+/* Returns 1 if link l is up */
+int link_up(sim_t *s, int l) {
+	sim_link_t *link = &s->links[l];
+	return LINK_UP(table_get_by_id(s->routers[link->a].router.neighbors, s->routers[link->b].id));
+}
+
+/* Returns how long a link failing now stays down */
+double down_time(sim_t *s) {
+	if (s->down_dist == DOWN_EXPONENTIAL) {
+		return -log(1 - random_unit()) * s->down_time;
+	} else if (s->down_dist == DOWN_UNIFORM) {
+		return random_unit() * 2 * s->down_time;
+	}
+	return s->down_time;
+}
+
+/* Records a change of the given kind made at when. Returns its tag. */
+int add_change(sim_t *s, double when, int kind) {
+	int tag;
+	if (s->num_changes == s->changes_cap) {
+		s->changes_cap = s->changes_cap > 0 ? s->changes_cap * 2 : 256;
+		s->changes = realloc(s->changes, s->changes_cap * sizeof(sim_change_t));
+	}
+	tag = s->num_changes++;
+	s->changes[tag].time = when;
+	s->changes[tag].kind = kind;
+	s->changes[tag].last_change = 0;
+	s->changes[tag].last_flood = 0;
+	return tag;
+}
+
+/* Picks a link that is up and fails it or gives it a new cost. A failed
+   link is left alone until its restore event brings it back, so a change
+   finding every link down is skipped. */
+void churn(sim_t *s, double when, int hot_links, double fail_fraction) {
+	int limit = hot_links > 0 && hot_links < s->num_links ? hot_links : s->num_links;
+	int start = rand() % limit;
+	int cost = 1 + rand() % MAX_COST;
+	int kind = random_unit() < fail_fraction ? CHURN_FAIL : CHURN_COST;
+	sim_link_t *link;
+	int tag;
+	int l;
+
+	// Take the first link up from a random starting point
+	for (l = 0; l < limit && !link_up(s, (start + l) % limit); ++l);
+	if (l == limit) {
+		return;
+	}
+	link = &s->links[(start + l) % limit];
+
+	tag = add_change(s, when, kind);
+	change_end(s, link->a, link->b, kind, cost, when, tag);
+	change_end(s, link->b, link->a, kind, cost, when, tag);
+
+	if (kind == CHURN_FAIL) {
+		sim_event_t ev;
+		memset(&ev, '\0', sizeof(ev));
+		ev.time = when + down_time(s);
+		ev.type = SIM_RESTORE;
+		ev.link = (start + l) % limit;
+		sim_push(s, ev);
+	}
+}
+
+/* Brings failed link l back up */
+void restore(sim_t *s, double when, int l) {
+	sim_link_t *link = &s->links[l];
+	int tag = add_change(s, when, CHURN_RESTORE);
+	change_end(s, link->a, link->b, CHURN_RESTORE, 0, when, tag);
+	change_end(s, link->b, link->a, CHURN_RESTORE, 0, when, tag);
+}
+
+void deliver(sim_t *s, sim_event_t *ev) {
+	sim_router_t *sr = &s->routers[ev->router];
+	vector_p before = sr->router.routing_table;
+	double start = ev->time > sr->busy_until ? ev->time : sr->busy_until;
+	char ignore_id[MAX_ID_LEN];
+	double cpu = cpu_sec();
+	double done;
+	int action;
+
+	action = handle_lsp(&sr->router, ev->packet, ignore_id, s->base + (time_t) start);
+	cpu = cpu_sec() - cpu;
+	sr->cpu += cpu;
+	done = start + cpu;
+	sr->busy_until = done;
+	note_change(s, ev->tag, done, sr->router.routing_table != before);
+	if (action & LSP_FORWARD) {
+		flood(s, ev->router, ev->packet, ignore_id, done, ev->tag);
+	}
+	pool_put(s->packets, ev->packet);
+
+	// A border router's summaries may have changed, and go out at once
+	// just as routed_LS sends changed fragments on its next pass
+	send_own_lsp(s, ev->router, done, ev->tag);
+}
+
+void timer(sim_t *s, sim_event_t *ev) {
+	sim_router_t *sr = &s->routers[ev->router];
+	double start = ev->time > sr->busy_until ? ev->time : sr->busy_until;
+	double cpu = cpu_sec();
+	double done;
+
+	age_lsdb(&sr->router, s->base + (time_t) start);
+	cpu = cpu_sec() - cpu;
+	sr->cpu += cpu;
+	done = start + cpu;
+	sr->busy_until = done;
+	send_own_lsp(s, ev->router, done, -1);
+}
+
+int compare_double(const void *a, const void *b) {
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+	return x < y ? -1 : x > y;
+}
+
+/* Prints the mean, median, 99th percentile and maximum of n times in ms */
+void print_spread(char *label, double *times, int n) {
+	double sum = 0;
+	int i;
+
+	if (n == 0) {
+		printf("%s: none\n", label);
+		return;
+	}
+	qsort(times, n, sizeof(double), compare_double);
+	for (i = 0; i < n; ++i) {
+		sum += times[i];
+	}
+	printf("%s (ms): mean %.3f  p50 %.3f  p99 %.3f  max %.3f\n", label,
+		sum * 1e3 / n, times[n / 2] * 1e3, times[(n * 99) / 100] * 1e3, times[n - 1] * 1e3);
+}
+
+/* Counts the pairs of routers where the first has no route to the second */
+int count_unreachable(sim_t *s) {
+	int unreachable = 0;
+	int i;
+	int j;
+
+	for (i = 0; i < s->num_routers; ++i) {
+		vector_p table = s->routers[i].router.routing_table;
+		for (j = 0; j < s->num_routers; ++j) {
+			if (i != j && !table_contains(table, s->routers[j].id)) {
+				++unreachable;
+			}
+		}
+	}
+	return unreachable;
+}
+
+/* Lists the area of every link of every router, which is what each router
+   would read out of the initialization file */
+void find_members(sim_t *s) {
+	int i;
+	unsigned int k;
+
+	s->members = create_vector();
+	for (i = 0; i < s->num_routers; ++i) {
+		router_t *r = &s->routers[i].router;
+		for (k = 0; k < r->link_areas->length; ++k) {
+			area_member_t member;
+			memset(&member, '\0', sizeof(member));
+			memcpy(member.id, s->routers[i].id, MAX_ID_LEN);
+			member.area = *(int *) vector_get(r->link_areas, k);
+			vector_add(s->members, &member, sizeof(member));
+		}
+	}
+}
+
+void print_results(sim_t *s, double startup, int unreachable, int verbose) {
+	double *reconverge = malloc((s->num_changes + 1) * sizeof(double));
+	double *flooded = malloc((s->num_changes + 1) * sizeof(double));
+	int kinds[3] = { 0, 0, 0 };
+	int num_reconverge = 0;
+	int num_flooded = 0;
+	double total_cpu = 0;
+	double max_cpu = 0;
+	unsigned long total_recvd = 0;
+	unsigned long total_flooded = 0;
+	unsigned long total_recomputes = 0;
+	unsigned long total_known = 0;
+	unsigned long max_known = 0;
+	int busiest = 0;
+	int i;
+
+	for (i = 0; i < s->num_changes; ++i) {
+		sim_change_t *c = &s->changes[i];
+		kinds[c->kind]++;
+		if (c->last_change > 0) {
+			reconverge[num_reconverge++] = c->last_change - c->time;
+		}
+		if (c->last_flood > 0) {
+			flooded[num_flooded++] = c->last_flood - c->time;
+		}
+	}
+
+	printf("startup: converged in %.3fms, %s\n", startup * 1e3,
+		unreachable > 0 ? "SOME ROUTERS UNREACHABLE" : "every router reaches every other");
+	if (unreachable > 0) {
+		printf("unreachable: %d of %d router pairs\n", unreachable, s->num_routers * (s->num_routers - 1));
+	}
+	printf("changes: %d (%d cost, %d fail, %d restore), %d changed routes\n", s->num_changes,
+		kinds[CHURN_COST], kinds[CHURN_FAIL], kinds[CHURN_RESTORE], num_reconverge);
+	print_spread("reconverge", reconverge, num_reconverge);
+	print_spread("flood done", flooded, num_flooded);
+
+	if (verbose) {
+		printf("router    CPU (ms)  LSPs recvd  flooded  recomputes  LSDB routers\n");
+	}
+	for (i = 0; i < s->num_routers; ++i) {
+		sim_router_t *sr = &s->routers[i];
+		unsigned long known = 0;
+		int a;
+		for (a = 0; a < sr->router.num_areas; ++a) {
+			known += sr->router.areas[a].lsdb->num_routers;
+		}
+		if (verbose) {
+			printf("%-8s %9.3f %11lu %8lu %11lu %13lu\n", sr->id, sr->cpu * 1e3,
+				sr->router.lsps_recvd, sr->flooded, sr->router.recomputes, known);
+		}
+		total_known += known;
+		if (known > max_known) {
+			max_known = known;
+		}
+		total_cpu += sr->cpu;
+		total_recvd += sr->router.lsps_recvd;
+		total_flooded += sr->flooded;
+		total_recomputes += sr->router.recomputes;
+		if (sr->cpu > max_cpu) {
+			max_cpu = sr->cpu;
+			busiest = i;
+		}
+	}
+	printf("per router: %.3fms CPU (busiest %s %.3fms), %lu LSPs received, %lu flooded, %lu recomputes\n",
+		total_cpu * 1e3 / s->num_routers, s->routers[busiest].id, max_cpu * 1e3,
+		total_recvd / s->num_routers, total_flooded / s->num_routers, total_recomputes / s->num_routers);
+	printf("LSDB size: %lu routers per router, %lu at most\n", total_known / s->num_routers, max_known);
+	printf("total: %.3fms CPU, %lu LSPs received, %lu flooded, %lu recomputes\n",
+		total_cpu * 1e3, total_recvd, total_flooded, total_recomputes);
+
+	free(reconverge);
+	free(flooded);
+}
+
+int main(int argc, char *argv[]) {
+	sim_t s;
+	hashmap_p index = create_hashmap();
+	char *gap_names[] = { "fixed", "poisson", "burst" };
+	int num_routers = DEFAULT_ROUTERS;
+	int degree = DEFAULT_DEGREE;
+	int num_areas = 1;
+	double duration = DEFAULT_DURATION;
+	double rate = DEFAULT_RATE;
+	double fail_fraction = DEFAULT_FAIL_FRACTION;
+	double down = DEFAULT_DOWN_TIME;
+	char *down_names[] = { "fixed", "exponential", "uniform" };
+	int down_dist = DOWN_EXPONENTIAL;
+	double delay_ms = DEFAULT_DELAY_MS;
+	double startup = 0;
+	int unreachable = -1;
+	double end;
+	sim_event_t first;
+	int gap = GAP_POISSON;
+	int hot_links = 0;
+	int dense_spf = 0;
+	int verbose = 0;
+	int burst = 0;
+	int opt;
+	int i;
+
+	srand(1);
+	while ((opt = getopt(argc, argv, "n:k:A:t:r:a:x:D:o:h:d:s:mv")) != -1) {
+		switch (opt) {
+		case 'n':
+			num_routers = atoi(optarg);
+			break;
+		case 'k':
+			degree = atoi(optarg);
+			break;
+		case 'A':
+			num_areas = atoi(optarg);
+			break;
+		case 't':
+			duration = atof(optarg);
+			break;
+		case 'r':
+			rate = atof(optarg);
+			break;
+		case 'a':
+			for (gap = 0; gap <= GAP_BURST && strcmp(optarg, gap_names[gap]) != 0; ++gap);
+			break;
+		case 'x':
+			fail_fraction = atof(optarg);
+			break;
+		case 'D':
+			down = atof(optarg);
+			break;
+		case 'o':
+			for (down_dist = 0; down_dist <= DOWN_UNIFORM && strcmp(optarg, down_names[down_dist]) != 0; ++down_dist);
+			break;
+		case 'h':
+			hot_links = atoi(optarg);
+			break;
+		case 'd':
+			delay_ms = atof(optarg);
+			break;
+		case 's':
+			srand(atoi(optarg));
+			break;
+		case 'm':
+			dense_spf = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s %s\n", argv[0], USAGE);
+			return EXIT_FAILURE;
+		}
+	}
+	if (num_routers < 2 || degree < 2 || num_areas < 1 || num_routers < 2 * num_areas || duration <= 0 || rate <= 0 || gap > GAP_BURST || down < 0 || down_dist > DOWN_UNIFORM || delay_ms < 0) {
+		fprintf(stderr, "Usage: %s %s\n", argv[0], USAGE);
+		return EXIT_FAILURE;
+	}
+
+	memset(&s, '\0', sizeof(s));
+	s.delay = delay_ms / 1e3;
+	s.down_time = down;
+	s.down_dist = down_dist;
+	s.base = time(NULL);
+	s.packets = create_pool(sizeof(lsp_packet_t), PACKETS_PER_SLAB);
+	if ((s.logfp = fopen("/dev/null", "w")) == NULL) {
+		perror("fopen");
+		return EXIT_FAILURE;
+	}
+
+	if (optind < argc) {
+		if (load_topology(&s, index, argv[optind]) < 0) {
+			return EXIT_FAILURE;
+		}
+	} else {
+		build_topology(&s, index, num_routers, degree, num_areas);
+	}
+	index_links(&s, index);
+	find_members(&s);
+	if (s.num_links == 0) {
+		fprintf(stderr, "no links to change\n");
+		return EXIT_FAILURE;
+	}
+
+	// Bring every router up with its LSP ready to go
+	for (i = 0; i < s.num_routers; ++i) {
+		sim_router_t *sr = &s.routers[i];
+		sim_event_t ev;
+		int a;
+		int f;
+		sr->router.id = sr->id;
+		sr->router.logfp = s.logfp;
+		sr->router.members = s.members;
+		if (dense_spf) {
+			sr->router.dense = create_spf_dense();
+		}
+		create_areas(&sr->router);
+		for (a = 0; a < sr->router.num_areas; ++a) {
+			for (f = 0; f < sr->router.areas[a].num_fragments; ++f) {
+				sr->router.areas[a].fragments[f].dirty = 1;
+			}
+		}
+		memset(&ev, '\0', sizeof(ev));
+		ev.time = random_unit() * TIMER_INTERVAL;
+		ev.type = SIM_TIMER;
+		ev.router = i;
+		sim_push(&s, ev);
+	}
+
+	printf("%d routers, %d links (%d changing), %.1fs of %s changes at %.1f/s, %.0f%% failures down %.3fs (%s), %.3fms link delay\n",
+		s.num_routers, s.num_links, hot_links > 0 && hot_links < s.num_links ? hot_links : s.num_links,
+		duration, gap_names[gap], rate, fail_fraction * 100, down, down_names[down_dist], delay_ms);
+
+	// Flood every router's LSP at once, then leave refreshes to the timers
+	for (i = 0; i < s.num_routers; ++i) {
+		send_own_lsp(&s, i, 0, -1);
+	}
+
+	end = CHURN_START + duration;
+	memset(&first, '\0', sizeof(first));
+	first.time = CHURN_START;
+	first.type = SIM_CHURN;
+	sim_push(&s, first);
+
+	// Stop changing things at the end but let the last floods settle
+	while (s.heap_len > 0) {
+		sim_event_t ev = sim_pop(&s);
+
+		if (ev.type == SIM_DELIVER) {
+			deliver(&s, &ev);
+			if (ev.time < CHURN_START && s.routers[ev.router].busy_until > startup) {
+				startup = s.routers[ev.router].busy_until;
+			}
+
+		} else if (ev.type == SIM_TIMER) {
+			timer(&s, &ev);
+			ev.time += TIMER_INTERVAL;
+			if (ev.time < end) {
+				sim_push(&s, ev);
+			}
+
+		} else if (ev.type == SIM_CHURN) {
+			// The network has converged and nothing has failed yet
+			if (unreachable < 0) {
+				unreachable = count_unreachable(&s);
+			}
+			churn(&s, ev.time, hot_links, fail_fraction);
+			if (gap == GAP_FIXED) {
+				ev.time += 1 / rate;
+			} else if (gap == GAP_POISSON) {
+				ev.time += -log(1 - random_unit()) / rate;
+			} else if (++burst < BURST_SIZE) {
+				ev.time += BURST_GAP;
+			} else {
+				burst = 0;
+				ev.time += fmax(BURST_SIZE / rate - (BURST_SIZE - 1) * BURST_GAP, BURST_GAP);
+			}
+			if (ev.time < end) {
+				sim_push(&s, ev);
+			}
+
+		} else if (ev.type == SIM_RESTORE) {
+			// Links still down at the end stay down
+			if (ev.time < end) {
+				restore(&s, ev.time, ev.link);
+			}
+		}
+	}
+
+	print_results(&s, startup, unreachable, verbose);
+
+	for (i = 0; i < s.num_routers; ++i) {
+		sim_router_t *sr = &s.routers[i];
+		destroy_areas(&sr->router);
+		destroy_vector(sr->router.neighbors);
+		destroy_vector(sr->router.link_areas);
+		destroy_tables(&sr->router);
+		if (sr->router.dense != NULL) {
+			destroy_spf_dense(sr->router.dense);
+		}
+		free(sr->peers);
+	}
+	free(s.routers);
+	free(s.links);
+	free(s.heap);
+	free(s.changes);
+	destroy_vector(s.members);
+	destroy_pool(s.packets);
+	destroy_hashmap(index);
+	fclose(s.logfp);
+	return unreachable > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,355 @@
+#define _GNU_SOURCE
+
+#include "feed.h"
+#include "spf.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+
+typedef struct feed_msg {
+	int refs;
+	size_t len;
+	char data[];
+} feed_msg_t;
+
+typedef struct feed_node {
+	feed_msg_t *msg;
+	struct feed_node *next;
+} feed_node_t;
+
+typedef struct feed_client {
+	int sock;
+	feed_node_t *head;
+	feed_node_t *tail;
+	size_t offset;   // Bytes of the head message already sent
+	size_t backlog;  // Bytes queued and not yet sent
+	int dead;
+	int out_armed;   // feed_wait() polls outstanding
+	int hup_armed;
+	struct feed_client *next;
+} feed_client_t;
+
+/* Allocate a message with room for count routes. It starts with one
+   reference held by the caller. */
+static feed_msg_t* feed_msg(int type, uint64_t version, size_t count){
+	feed_msg_t *msg = (feed_msg_t*)malloc(sizeof(feed_msg_t) +
+					sizeof(feed_header_t) + sizeof(feed_route_t) * count);
+	feed_header_t *header = (feed_header_t*)msg->data;
+	msg->refs = 1;
+	msg->len = sizeof(feed_header_t);
+	header->type = type;
+	header->count = 0;
+	header->version = version;
+	return msg;
+}
+
+static void feed_msg_add(feed_msg_t *msg, int op, table_entry_t *entry){
+	feed_header_t *header = (feed_header_t*)msg->data;
+	feed_route_t *route = (feed_route_t*)(msg->data + msg->len);
+	route->op = op;
+	route->cost = entry->cost;
+	route->out_port = entry->out_port;
+	route->dest_port = entry->dest_port;
+	memcpy(route->dest_id, entry->dest_id, MAX_ID_LEN);
+	msg->len += sizeof(feed_route_t);
+	header->count++;
+}
+
+static void feed_msg_release(feed_msg_t *msg){
+	if(--msg->refs == 0)
+		free(msg);
+}
+
+static feed_msg_t* feed_snapshot(feed_p f, vector_p table){
+	feed_msg_t *msg = feed_msg(FEED_SNAPSHOT, f->version, table->length);
+	unsigned int i;
+	for(i = 0; i < table->length; ++i)
+		feed_msg_add(msg, FEED_ADD, vector_get(table, i));
+	return msg;
+}
+
+/* FNV-1a over an ID that may fill all MAX_ID_LEN bytes */
+static unsigned int feed_hash(const char *id){
+	unsigned int h = 2166136261u;
+	int i;
+	for(i = 0; i < MAX_ID_LEN && id[i] != '\0'; ++i)
+		h = (h ^ (unsigned char)id[i]) * 16777619u;
+	return h;
+}
+
+/* Index the old table by destination. The index is kept between deltas and
+   only grows, so a steady table is diffed without allocating. */
+static void feed_index(feed_p f, vector_p old_table){
+	unsigned int mask;
+	unsigned int i;
+
+	if(f->size < old_table->length * 2 + 2){
+		while(f->size < old_table->length * 2 + 2)
+			f->size = f->size > 0 ? f->size * 2 : 16;
+		f->slots = (int*)realloc(f->slots, sizeof(int) * f->size);
+		f->seen = (char*)realloc(f->seen, f->size);
+	}
+	mask = f->size - 1;
+	memset(f->slots, 0xff, sizeof(int) * f->size);
+	memset(f->seen, 0, old_table->length);
+
+	for(i = 0; i < old_table->length; ++i){
+		table_entry_t *entry = vector_get(old_table, i);
+		unsigned int h;
+		for(h = feed_hash(entry->dest_id) & mask; f->slots[h] >= 0; h = (h + 1) & mask)
+			;
+		f->slots[h] = i;
+	}
+}
+
+static table_entry_t* feed_lookup(feed_p f, vector_p old_table, const char *id, int *index){
+	unsigned int mask = f->size - 1;
+	unsigned int h;
+	for(h = feed_hash(id) & mask; (*index = f->slots[h]) >= 0; h = (h + 1) & mask){
+		table_entry_t *old = vector_get(old_table, *index);
+		if(strncmp(old->dest_id, id, MAX_ID_LEN) == 0)
+			return old;
+	}
+	return NULL;
+}
+
+static feed_msg_t* feed_delta(feed_p f, vector_p old_table, vector_p new_table){
+	feed_msg_t *msg = feed_msg(FEED_DELTA, f->version,
+					old_table->length + new_table->length);
+	unsigned int i;
+	int index;
+
+	feed_index(f, old_table);
+
+	for(i = 0; i < new_table->length; ++i){
+		table_entry_t *entry = vector_get(new_table, i);
+		table_entry_t *old = feed_lookup(f, old_table, entry->dest_id, &index);
+		if(old == NULL){
+			feed_msg_add(msg, FEED_ADD, entry);
+		} else {
+			f->seen[index] = 1;
+			if(old->cost != entry->cost || old->out_port != entry->out_port ||
+					old->dest_port != entry->dest_port)
+				feed_msg_add(msg, FEED_CHANGE, entry);
+		}
+	}
+
+	for(i = 0; i < old_table->length; ++i){
+		if(!f->seen[i])
+			feed_msg_add(msg, FEED_REMOVE, vector_get(old_table, i));
+	}
+	return msg;
+}
+
+static void feed_queue(feed_client_t *c, feed_msg_t *msg){
+	feed_node_t *node = (feed_node_t*)malloc(sizeof(feed_node_t));
+	node->msg = msg;
+	node->next = NULL;
+	msg->refs++;
+	if(c->tail == NULL)
+		c->head = node;
+	else
+		c->tail->next = node;
+	c->tail = node;
+	c->backlog += msg->len;
+}
+
+/* Drop everything queued for a client except a partly sent message, which
+   has to be finished to keep the stream in step */
+static void feed_drop_queued(feed_client_t *c){
+	feed_node_t *node = c->head;
+	feed_node_t *keep = NULL;
+
+	if(node != NULL && c->offset > 0){
+		keep = node;
+		node = node->next;
+		keep->next = NULL;
+	}
+	while(node != NULL){
+		feed_node_t *next = node->next;
+		c->backlog -= node->msg->len;
+		feed_msg_release(node->msg);
+		free(node);
+		node = next;
+	}
+	c->head = c->tail = keep;
+}
+
+feed_p create_feed(char *path){
+	struct sockaddr_un addr;
+	feed_p f;
+	int sock;
+
+	memset(&addr, '\0', sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(strlen(path) >= sizeof(addr.sun_path)){
+		fprintf(stderr, "Socket path too long: %s\n", path);
+		return NULL;
+	}
+	strcpy(addr.sun_path, path);
+
+	if((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0){
+		perror("socket");
+		return NULL;
+	}
+	unlink(path);
+	if(bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0){
+		perror("bind");
+		close(sock);
+		return NULL;
+	}
+	if(listen(sock, 16) != 0){
+		perror("listen");
+		close(sock);
+		unlink(path);
+		return NULL;
+	}
+	fcntl(sock, F_SETFL, O_NONBLOCK);
+
+	f = (feed_p)malloc(sizeof(struct feed));
+	f->sock = sock;
+	f->path = strdup(path);
+	f->version = 0;
+	f->clients = NULL;
+	f->slots = NULL;
+	f->seen = NULL;
+	f->size = 0;
+	return f;
+}
+
+void feed_accept(feed_p f, vector_p table){
+	int sock;
+	while((sock = accept4(f->sock, NULL, NULL, SOCK_NONBLOCK)) >= 0){
+		feed_client_t *c = (feed_client_t*)calloc(1, sizeof(feed_client_t));
+		feed_msg_t *msg = feed_snapshot(f, table);
+		c->sock = sock;
+		feed_queue(c, msg);
+		feed_msg_release(msg);
+		c->next = f->clients;
+		f->clients = c;
+	}
+	if(errno != EAGAIN && errno != EWOULDBLOCK)
+		perror("accept");
+}
+
+void feed_publish(feed_p f, vector_p old_table, vector_p new_table){
+	feed_client_t *c;
+	feed_msg_t *delta;
+	feed_msg_t *snapshot = NULL;
+
+	f->version++;
+	if(f->clients == NULL)
+		return;
+
+	delta = feed_delta(f, old_table, new_table);
+	for(c = f->clients; c != NULL; c = c->next){
+		if(c->backlog + delta->len <= FEED_MAX_BACKLOG){
+			feed_queue(c, delta);
+			continue;
+		}
+
+		// Too far behind, start the subscriber over from a snapshot
+		if(snapshot == NULL)
+			snapshot = feed_snapshot(f, new_table);
+		feed_drop_queued(c);
+		feed_queue(c, snapshot);
+	}
+	feed_msg_release(delta);
+	if(snapshot != NULL)
+		feed_msg_release(snapshot);
+}
+
+static void destroy_feed_client(feed_client_t *c){
+	c->offset = 0;
+	feed_drop_queued(c);
+	close(c->sock);
+	free(c);
+}
+
+void feed_flush(feed_p f){
+	feed_client_t **link = &f->clients;
+	feed_client_t *c;
+
+	while((c = *link) != NULL){
+		while(c->head != NULL && !c->dead){
+			feed_msg_t *msg = c->head->msg;
+			ssize_t n = send(c->sock, msg->data + c->offset, msg->len - c->offset,
+							MSG_DONTWAIT | MSG_NOSIGNAL);
+			if(n < 0){
+				if(errno != EAGAIN && errno != EWOULDBLOCK)
+					c->dead = 1;
+				break;
+			}
+			c->offset += n;
+			c->backlog -= n;
+			if(c->offset == msg->len){
+				feed_node_t *node = c->head;
+				c->head = node->next;
+				if(c->head == NULL)
+					c->tail = NULL;
+				c->offset = 0;
+				feed_msg_release(msg);
+				free(node);
+			}
+		}
+
+		if(c->dead && !c->out_armed && !c->hup_armed){
+			*link = c->next;
+			destroy_feed_client(c);
+		} else {
+			// Wake any polls still armed so the client can be freed
+			if(c->dead)
+				shutdown(c->sock, SHUT_RDWR);
+			link = &c->next;
+		}
+	}
+}
+
+struct feed_client* feed_wait(feed_p f, int *sock, int *events){
+	feed_client_t *c;
+	for(c = f->clients; c != NULL; c = c->next){
+		if(c->dead)
+			continue;
+		if(!c->hup_armed){
+			c->hup_armed = 1;
+			*events = POLLRDHUP;
+		} else if(c->head != NULL && !c->out_armed){
+			c->out_armed = 1;
+			*events = POLLOUT;
+		} else {
+			continue;
+		}
+		*sock = c->sock;
+		return c;
+	}
+	return NULL;
+}
+
+void feed_ready(feed_p f, struct feed_client *c, int events, int revents){
+	if(events & POLLOUT)
+		c->out_armed = 0;
+	else
+		c->hup_armed = 0;
+	if(revents & (POLLRDHUP | POLLHUP | POLLERR))
+		c->dead = 1;
+	feed_flush(f);
+}
+
+void destroy_feed(feed_p f){
+	while(f->clients != NULL){
+		feed_client_t *c = f->clients;
+		f->clients = c->next;
+		destroy_feed_client(c);
+	}
+	close(f->sock);
+	unlink(f->path);
+	free(f->path);
+	free(f->slots);
+	free(f->seen);
+	free(f);
+}
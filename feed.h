@@ -0,0 +1,91 @@
+#ifndef __FEED_H__
+#define __FEED_H__
+
+/* Route change feed. Subscribers connect to a Unix domain socket and get a
+   snapshot of the routing table followed by one delta message for every
+   change to it, so their work scales with the size of each change rather
+   than the size of the table.
+
+   Every message is a feed_header_t followed by count feed_route_t records,
+   all in host byte order. A snapshot lists every route as FEED_ADD. A delta
+   lists only the routes that were added, removed or changed cost or next
+   hop. version counts routing table changes; a delta moves a subscriber
+   from version - 1 to version.
+
+   A subscriber that falls more than FEED_MAX_BACKLOG bytes behind has its
+   queued deltas dropped and is sent a fresh snapshot instead. */
+
+#include <stdint.h>
+#include "vector.h"
+#include "lsp.h"
+
+#define FEED_MAX_BACKLOG (1 << 20)
+
+/* Message types */
+#define FEED_SNAPSHOT 1
+#define FEED_DELTA 2
+
+/* Route operations */
+#define FEED_ADD 1
+#define FEED_REMOVE 2
+#define FEED_CHANGE 3
+
+typedef struct {
+	uint32_t type;
+	uint32_t count;
+	uint64_t version;
+} feed_header_t;
+
+typedef struct {
+	uint32_t op;
+	uint32_t cost;
+	uint32_t out_port;
+	uint32_t dest_port;
+	char dest_id[MAX_ID_LEN];
+} feed_route_t;
+
+struct feed_msg;
+struct feed_client;
+
+struct feed{
+	int sock;
+	char *path;
+	uint64_t version;
+	struct feed_client *clients;
+	int *slots;         // Open addressing index into the old table of a delta
+	char *seen;         // Old routes matched by the new table
+	unsigned int size;  // Slots held, at least twice the old table
+};
+
+typedef struct feed * feed_p;
+
+/* Start listening for subscribers on the Unix socket at path. Returns NULL
+   on failure. It must be destroyed by destroy_feed(). */
+feed_p create_feed(char *path);
+
+/* Accept any waiting subscribers and queue a snapshot of table for each */
+void feed_accept(feed_p f, vector_p table);
+
+/* Queue the differences between two versions of the routing table, both
+   vectors of table_entry_t, to every subscriber */
+void feed_publish(feed_p f, vector_p old_table, vector_p new_table);
+
+/* Write as much queued data as subscribers will take without blocking, and
+   disconnect any that have gone away */
+void feed_flush(feed_p f);
+
+/* For event loops that wait on subscriber sockets themselves. Returns a
+   subscriber that needs a poll armed on *sock for *events, or NULL if none
+   do: POLLOUT when data is left queued behind a full socket, and POLLRDHUP
+   at all times to notice it hanging up. Call it after feed_flush() until it
+   returns NULL. A subscriber is not freed while a poll on it is armed. */
+struct feed_client* feed_wait(feed_p f, int *sock, int *events);
+
+/* A poll from feed_wait() on c for events completed with revents. Flushes
+   the subscribers, dropping c if it hung up. */
+void feed_ready(feed_p f, struct feed_client *c, int events, int revents);
+
+/* Disconnect every subscriber and remove the socket */
+void destroy_feed(feed_p f);
+
+#endif
@@ -79,7 +79,7 @@ void hashmap_remove(hashmap_p m, char* key){
 		m->destructor(itm->val);
 		free(itm);
 		
-		keyind = vector_index(m->keys, key, n);
+		keyind = vector_index(m->keys, key, n+1);
 		vector_remove(m->keys, keyind);
 		m->size--;
 	}
@@ -100,10 +100,11 @@ void destroy_hashmap(hashmap_p m){
 	for(x=0;x<m->num_buckets;++x){
 		itm = m->buckets[x];
 		while(itm!=NULL){
+			item_t* next = itm->next;
 			free(itm->key);
 			m->destructor(itm->val);
 			free(itm);
-			itm = itm->next;
+			itm = next;
 		}
 	}
 	destroy_vector(m->keys);
@@ -0,0 +1,171 @@
+#include "lsdb.h"
+#include <string.h>
+
+#define LSDB_MIN_ROUTERS 16
+
+static unsigned long lsdb_versions;  // Last lsdb_router_t version handed out
+
+unsigned int lsdb_hash(const char *id){
+	unsigned int h = 2166136261u;
+	int i;
+	for(i = 0; i < MAX_ID_LEN - 1 && id[i] != '\0'; ++i)
+		h = (h ^ (unsigned char)id[i]) * 16777619u;
+	return h;
+}
+
+/* Size the index for the router array and fill it from the routers held */
+static void lsdb_reindex(lsdb_p db){
+	int i;
+	db->slots = (int*)realloc(db->slots, sizeof(int) * db->router_cap * 2);
+	db->mask = db->router_cap * 2 - 1;
+	memset(db->slots, 0xff, sizeof(int) * db->router_cap * 2);
+	for(i = 0; i < db->num_routers; ++i){
+		unsigned int h = lsdb_hash(db->routers[i]->id) & db->mask;
+		while(db->slots[h] >= 0)
+			h = (h + 1) & db->mask;
+		db->slots[h] = i;
+	}
+}
+
+static void destroy_lsdb_router(lsdb_router_t *router){
+	int i;
+	for(i = 0; i < router->num_fragments; ++i)
+		free(router->fragments[i]);
+	free(router);
+}
+
+lsdb_p create_lsdb(){
+	lsdb_p db = (lsdb_p)calloc(1, sizeof(struct lsdb));
+	db->router_cap = LSDB_MIN_ROUTERS;
+	db->routers = (lsdb_router_t**)malloc(sizeof(lsdb_router_t*) * db->router_cap);
+	lsdb_reindex(db);
+	return db;
+}
+
+lsdb_router_t* lsdb_get(lsdb_p db, char *id){
+	unsigned int h = lsdb_hash(id) & db->mask;
+	int n;
+	while((n = db->slots[h]) >= 0){
+		if(strncmp(db->routers[n]->id, id, MAX_ID_LEN - 1) == 0)
+			return db->routers[n];
+		h = (h + 1) & db->mask;
+	}
+	return NULL;
+}
+
+/* Add an empty entry for router id, which must not be held yet */
+static lsdb_router_t* lsdb_add(lsdb_p db, char *id){
+	lsdb_router_t *router = (lsdb_router_t*)calloc(1, sizeof(lsdb_router_t));
+	unsigned int h = lsdb_hash(id) & db->mask;
+
+	memcpy(router->id, id, MAX_ID_LEN - 1);  // Last byte stays 0
+	router->version = ++lsdb_versions;
+	while(db->slots[h] >= 0)
+		h = (h + 1) & db->mask;
+	db->slots[h] = db->num_routers;
+	db->routers[db->num_routers++] = router;
+
+	// Keep room for the next one, and the index at most half full
+	if(db->num_routers == db->router_cap){
+		db->router_cap *= 2;
+		db->routers = (lsdb_router_t**)realloc(db->routers, sizeof(lsdb_router_t*) * db->router_cap);
+		lsdb_reindex(db);
+	}
+	return router;
+}
+
+int lsdb_seq(lsdb_p db, char *id, int fragment){
+	lsdb_router_t *router = lsdb_get(db, id);
+	if(router == NULL || fragment < 0 || fragment >= router->num_fragments ||
+			router->fragments[fragment] == NULL)
+		return -1;
+	return router->fragments[fragment]->seq_num;
+}
+
+int lsdb_update(lsdb_p db, lsp_packet_t *packet, time_t now){
+	lsp_header_t *header = &packet->header;
+	lsdb_router_t *router;
+	lsdb_fragment_t *frag;
+	size_t data_len = sizeof(lsp_entry_t) * header->entries;
+
+	if(header->fragment < 0 || header->fragment >= MAX_LSP_FRAGMENTS)
+		return LSDB_OLD;
+
+	if((router = lsdb_get(db, header->src_id)) == NULL)
+		router = lsdb_add(db, header->src_id);
+
+	frag = header->fragment < router->num_fragments ?
+				router->fragments[header->fragment] : NULL;
+	if(frag != NULL && frag->seq_num >= header->seq_num)
+		return LSDB_OLD;
+
+	// Same adjacencies, only the sequence number and age move on
+	if(frag != NULL && frag->entries == header->entries &&
+			memcmp(frag->data, packet->data, data_len) == 0){
+		frag->seq_num = header->seq_num;
+		frag->recv_time = now;
+		return LSDB_REFRESHED;
+	}
+
+	if(frag == NULL || frag->entries != header->entries){
+		frag = (lsdb_fragment_t*)realloc(frag, sizeof(lsdb_fragment_t) + data_len);
+		router->fragments[header->fragment] = frag;
+	}
+	frag->seq_num = header->seq_num;
+	frag->recv_time = now;
+	frag->entries = header->entries;
+	memcpy(frag->data, packet->data, data_len);
+	if(header->fragment >= router->num_fragments)
+		router->num_fragments = header->fragment + 1;
+	router->version = ++lsdb_versions;
+	return LSDB_CHANGED;
+}
+
+int lsdb_expire(lsdb_p db, time_t now, int max_age){
+	int expired = 0;
+	int kept = 0;
+	int i;
+	int f;
+
+	for(i = 0; i < db->num_routers; ++i){
+		lsdb_router_t *router = db->routers[i];
+		int before = expired;
+		int live = 0;
+		for(f = 0; f < router->num_fragments; ++f){
+			lsdb_fragment_t *frag = router->fragments[f];
+			if(frag == NULL)
+				continue;
+			if(frag->recv_time + max_age < now){
+				free(frag);
+				router->fragments[f] = NULL;
+				++expired;
+			} else {
+				live = f + 1;
+			}
+		}
+		if(expired > before)
+			router->version = ++lsdb_versions;
+		router->num_fragments = live;
+
+		// Forget routers with nothing left, closing up the gap in place
+		if(live == 0)
+			destroy_lsdb_router(router);
+		else
+			db->routers[kept++] = router;
+	}
+
+	if(kept < db->num_routers){
+		db->num_routers = kept;
+		lsdb_reindex(db);
+	}
+	return expired;
+}
+
+void destroy_lsdb(lsdb_p db){
+	int i;
+	for(i = 0; i < db->num_routers; ++i)
+		destroy_lsdb_router(db->routers[i]);
+	free(db->routers);
+	free(db->slots);
+	free(db);
+}
@@ -0,0 +1,66 @@
+#ifndef __LSDB_H__
+#define __LSDB_H__
+
+/* Link state database. Holds the latest copy of every LSP fragment heard
+   from other routers. Each fragment carries its own sequence number and
+   age, so fragments are replaced and expired independently of each other.
+   Routers are found through an open addressing index that grows with them,
+   so a lookup stays a probe or two however many routers there are. */
+
+#include <stdlib.h>
+#include <time.h>
+#include "lsp.h"
+
+/* Results of lsdb_update() */
+#define LSDB_OLD 0        // Duplicate or older sequence number, ignore
+#define LSDB_REFRESHED 1  // Newer sequence number, same adjacencies
+#define LSDB_CHANGED 2    // Adjacencies differ from the stored copy
+
+typedef struct {
+	int seq_num;
+	time_t recv_time;
+	int entries;
+	lsp_entry_t data[];
+} lsdb_fragment_t;
+
+typedef struct {
+	char id[MAX_ID_LEN];
+	int num_fragments;  // One past the highest fragment held
+	unsigned long version;  // New whenever the adjacencies change, never 0 and
+	                        // never reused by any LSDB in the process
+	lsdb_fragment_t *fragments[MAX_LSP_FRAGMENTS];
+} lsdb_router_t;
+
+struct lsdb {
+	lsdb_router_t **routers;  // Every router held, in the order first heard
+	int num_routers;
+	int router_cap;
+	int *slots;               // Open addressing index into routers
+	unsigned int mask;
+};
+
+typedef struct lsdb * lsdb_p;
+
+/* Create an empty database. It must be destroyed by destroy_lsdb(). */
+lsdb_p create_lsdb();
+
+/* Store the fragment carried by packet if it is newer than the copy held */
+int lsdb_update(lsdb_p db, lsp_packet_t *packet, time_t now);
+
+/* Get the sequence number held for a fragment, or -1 if there is none */
+int lsdb_seq(lsdb_p db, char *id, int fragment);
+
+/* Get everything held for router id, or NULL if nothing is */
+lsdb_router_t* lsdb_get(lsdb_p db, char *id);
+
+/* Drop fragments not refreshed within max_age seconds. Returns the number
+   of fragments dropped. */
+int lsdb_expire(lsdb_p db, time_t now, int max_age);
+
+/* FNV-1a over the part of a router ID that is kept, for indexes by ID */
+unsigned int lsdb_hash(const char *id);
+
+/* Free all of the memory associated with the database */
+void destroy_lsdb(lsdb_p db);
+
+#endif
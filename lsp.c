@@ -0,0 +1,53 @@
+#include "lsp.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Returns 1 if the header describes a packet we can hold */
+static int lsp_valid(lsp_header_t *header){
+	return header->length >= (int)sizeof(lsp_header_t) &&
+		header->length <= (int)sizeof(lsp_packet_t) &&
+		header->entries >= 0 &&
+		LSP_LENGTH(header->entries) <= (size_t)header->length;
+}
+
+lsp_packet_t* lsp_read(lsp_reader_t *rd, char **data, size_t *len){
+	size_t need;
+
+	// Whole packet available, hand it out without copying
+	if(rd->len == 0 && *len >= sizeof(lsp_header_t)){
+		lsp_header_t *header = (lsp_header_t*)*data;
+		if(lsp_valid(header) && *len >= (size_t)header->length){
+			*data += header->length;
+			*len -= header->length;
+			return (lsp_packet_t*)header;
+		}
+	}
+
+	while(*len > 0){
+		if(rd->len < sizeof(lsp_header_t)){
+			need = sizeof(lsp_header_t) - rd->len;
+		} else {
+			need = rd->packet.header.length - rd->len;
+		}
+		if(need > *len)
+			need = *len;
+		memcpy((char*)&rd->packet + rd->len, *data, need);
+		rd->len += need;
+		*data += need;
+		*len -= need;
+
+		if(rd->len == sizeof(lsp_header_t) && !lsp_valid(&rd->packet.header)){
+			fprintf(stderr, "invalid LSP length %d\n", rd->packet.header.length);
+			rd->len = 0;
+			*data += *len;
+			*len = 0;
+			return NULL;
+		}
+		if(rd->len >= sizeof(lsp_header_t) &&
+				rd->len == (size_t)rd->packet.header.length){
+			rd->len = 0;
+			return &rd->packet;
+		}
+	}
+	return NULL;
+}
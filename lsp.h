@@ -0,0 +1,57 @@
+#ifndef __LSP_H__
+#define __LSP_H__
+
+/* Link state packet format shared by the router and its tools */
+
+#include <stdlib.h>
+
+#define MAX_ID_LEN 24
+#define MAX_LSP_ENTRIES 64
+#define MAX_LSP_FRAGMENTS 64
+#define TTL 6
+#define FLAG_KILL 1
+
+/* Bytes on the wire for a packet carrying the given number of entries */
+#define LSP_LENGTH(entries) (sizeof(lsp_header_t) + sizeof(lsp_entry_t) * (entries))
+
+typedef struct {
+	int seq_num;
+	char src_id[MAX_ID_LEN];
+	int flags;
+	int length;
+	int entries;
+	int ttl;
+	int fragment;
+	int area;  // Area the packet is flooded in
+} lsp_header_t;
+
+typedef struct {
+	char id[MAX_ID_LEN];
+	int cost;
+} lsp_entry_t;
+
+typedef struct {
+	lsp_header_t header;
+	lsp_entry_t data[MAX_LSP_ENTRIES];
+} lsp_packet_t;
+
+/* A router and one of the areas it has links in */
+typedef struct {
+	char id[MAX_ID_LEN];
+	int area;
+} area_member_t;
+
+/* Reassembles packets out of a byte stream. Zero it before first use. */
+typedef struct {
+	size_t len;
+	lsp_packet_t packet;
+} lsp_reader_t;
+
+/* Consume bytes from *data until a whole packet is available and return it,
+   advancing *data and *len past it. The packet is either read in place from
+   *data, which must then be suitably aligned, or assembled in rd. Returns
+   NULL once all of *len is consumed without completing a packet. A header
+   with an impossible length discards the rest of the data. */
+lsp_packet_t* lsp_read(lsp_reader_t *rd, char **data, size_t *len);
+
+#endif
@@ -0,0 +1,313 @@
+/*
+ * lsp_bench.c
+ *
+ * Measures how many LSPs per second a single router can accept and flood.
+ * The benchmark stands in for every neighbor of the router under test,
+ * starts the router, pushes fresh LSPs at it over the first neighbor link
+ * and counts the copies it floods back out over all of them.
+ */
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include "vector.h"
+#include "lsp.h"
+
+#define USAGE "<router ID> <initialization file> <count> [router options]"
+#define ARG_MIN 4
+#define ROUTER_PATH "./routed_LS"
+#define BENCH_PREFIX "bench"
+#define NUM_SOURCES 64
+#define WINDOW 64
+#define IDLE_TIMEOUT_MS 5000
+
+typedef struct {
+	char id[MAX_ID_LEN];
+	int port;
+	int sock;
+	lsp_reader_t reader;
+} bench_peer_t;
+
+double now_sec() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Reads the neighbors of router_id out of the initialization file */
+void read_peers(FILE *fp, char *router_id, vector_p peers) {
+	char *line = NULL;
+	size_t len = 0;
+	char *str;
+
+	while (getline(&line, &len, fp) != -1) {
+		str = strtok(line, " ,<>\n");
+		if (str != NULL && strncmp(str, router_id, MAX_ID_LEN) == 0) {
+			char *port1 = strtok(NULL, " ,<>\n");
+			char *node  = strtok(NULL, " ,<>\n");
+			char *port2 = strtok(NULL, " ,<>\n");
+			if (port1 != NULL && node != NULL && port2 != NULL) {
+				bench_peer_t peer;
+				memset(&peer, '\0', sizeof(peer));
+				strncpy(peer.id, node, MAX_ID_LEN - 1);
+				peer.port = atoi(port2);
+				vector_add(peers, &peer, sizeof(peer));
+			}
+		}
+	}
+	free(line);
+}
+
+int listen_on(int port) {
+	struct sockaddr_in addr;
+	int sock;
+	int on = 1;
+
+	memset(&addr, '\0', sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = INADDR_ANY;
+
+	if ((sock = socket(PF_INET, SOCK_STREAM, 0)) < 0) {
+		perror("socket");
+		exit(EXIT_FAILURE);
+	}
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		perror("bind");
+		exit(EXIT_FAILURE);
+	}
+	if (listen(sock, 10) != 0) {
+		perror("listen");
+		exit(EXIT_FAILURE);
+	}
+	return sock;
+}
+
+/* Starts the router with its stdin on a pipe. Returns the write end. */
+int start_router(char *router_id, char *init_filename, char **opts, int num_opts, pid_t *pid) {
+	char log_filename[MAX_ID_LEN + 16];
+	char **args;
+	int fds[2];
+	int i;
+
+	snprintf(log_filename, sizeof(log_filename), "%s-bench-log.txt", router_id);
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		exit(EXIT_FAILURE);
+	}
+
+	if ((*pid = fork()) < 0) {
+		perror("fork");
+		exit(EXIT_FAILURE);
+	} else if (*pid == 0) {
+		args = malloc(sizeof(char *) * (num_opts + 5));
+		args[0] = ROUTER_PATH;
+		for (i = 0; i < num_opts; ++i) {
+			args[i + 1] = opts[i];
+		}
+		args[num_opts + 1] = router_id;
+		args[num_opts + 2] = log_filename;
+		args[num_opts + 3] = init_filename;
+		args[num_opts + 4] = NULL;
+		dup2(fds[0], fileno(stdin));
+		close(fds[1]);
+		execv(ROUTER_PATH, args);
+		perror("execv");
+		exit(EXIT_FAILURE);
+	}
+
+	close(fds[0]);
+	return fds[1];
+}
+
+/* Reads whatever is available on a peer. Returns the number of benchmark
+   LSPs it contained, or -1 once the router has closed the connection. */
+int drain_peer(bench_peer_t *peer) {
+	lsp_packet_t buf[16];
+	lsp_packet_t *packet;
+	char *data = (char *) buf;
+	size_t len;
+	int count = 0;
+	ssize_t n;
+
+	n = recv(peer->sock, buf, sizeof(buf), 0);
+	if (n == 0) {
+		return -1;
+	} else if (n < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			perror("recv");
+		}
+		return 0;
+	}
+
+	len = n;
+	while ((packet = lsp_read(&peer->reader, &data, &len)) != NULL) {
+		if (strncmp(packet->header.src_id, BENCH_PREFIX, strlen(BENCH_PREFIX)) == 0) {
+			++count;
+		}
+	}
+	return count;
+}
+
+int main(int argc, char *argv[]) {
+	char *router_id;
+	char *init_filename;
+	FILE *initfp;
+	vector_p peers;
+	struct pollfd *fds;
+	lsp_packet_t packet;
+	size_t tx_off = 0;
+	size_t tx_len = 0;
+	long count;
+	long sent = 0;
+	long forwarded = 0;
+	long expected;
+	double start;
+	double end;
+	pid_t pid;
+	int router_stdin;
+	int status;
+	unsigned int i;
+
+	if (argc < ARG_MIN) {
+		fprintf(stderr, "Usage: %s %s\n", argv[0], USAGE);
+		return EXIT_FAILURE;
+	}
+
+	router_id = argv[1];
+	init_filename = argv[2];
+	count = atol(argv[3]);
+
+	if ((initfp = fopen(init_filename, "r")) == NULL) {
+		fprintf(stderr, "Error opening file: %s\n", init_filename);
+		perror("fopen");
+		return EXIT_FAILURE;
+	}
+
+	peers = create_vector();
+	read_peers(initfp, router_id, peers);
+	fclose(initfp);
+	if (peers->length == 0) {
+		fprintf(stderr, "%s has no neighbors in %s\n", router_id, init_filename);
+		return EXIT_FAILURE;
+	}
+
+	// Listen as every neighbor, then let the router connect to us
+	for (i = 0; i < peers->length; ++i) {
+		bench_peer_t *peer = vector_get(peers, i);
+		peer->sock = listen_on(peer->port);
+	}
+	router_stdin = start_router(router_id, init_filename, argv + ARG_MIN, argc - ARG_MIN, &pid);
+
+	fds = malloc(sizeof(struct pollfd) * peers->length);
+	for (i = 0; i < peers->length; ++i) {
+		bench_peer_t *peer = vector_get(peers, i);
+		int listener = peer->sock;
+		if ((peer->sock = accept(listener, NULL, NULL)) < 0) {
+			perror("accept");
+			return EXIT_FAILURE;
+		}
+		close(listener);
+		fcntl(peer->sock, F_SETFL, O_NONBLOCK);
+		fds[i].fd = peer->sock;
+	}
+
+	// Every LSP is flooded back out to all neighbors
+	expected = count * peers->length;
+	memset(&packet, '\0', sizeof(packet));
+	start = end = now_sec();
+
+	while (forwarded < expected) {
+		int in_flight = sent - forwarded / (long) peers->length;
+		int retval;
+
+		for (i = 0; i < peers->length; ++i) {
+			fds[i].events = POLLIN;
+		}
+		if (tx_off < tx_len || (sent < count && in_flight < WINDOW)) {
+			fds[0].events |= POLLOUT;
+		}
+
+		if ((retval = poll(fds, peers->length, IDLE_TIMEOUT_MS)) < 0) {
+			perror("poll");
+			break;
+		} else if (retval == 0) {
+			fprintf(stderr, "timed out waiting for router\n");
+			break;
+		}
+
+		if (fds[0].revents & POLLOUT) {
+			bench_peer_t *peer = vector_get(peers, 0);
+			ssize_t n;
+			if (tx_off == tx_len) {
+				long src = sent % NUM_SOURCES;
+				snprintf(packet.header.src_id, MAX_ID_LEN, "%s%ld", BENCH_PREFIX, src);
+				packet.header.seq_num = sent / NUM_SOURCES + 1;
+				packet.header.ttl = TTL;
+				packet.header.entries = 1;
+				packet.header.length = LSP_LENGTH(1);
+				strncpy(packet.data[0].id, peer->id, MAX_ID_LEN);
+				packet.data[0].cost = 1;
+				tx_off = 0;
+				tx_len = packet.header.length;
+				++sent;
+			}
+			n = send(peer->sock, (char *) &packet + tx_off, tx_len - tx_off, 0);
+			if (n < 0) {
+				if (errno != EAGAIN && errno != EWOULDBLOCK) {
+					perror("send");
+					break;
+				}
+			} else {
+				tx_off += n;
+			}
+		}
+
+		for (i = 0; i < peers->length; ++i) {
+			if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+				int n = drain_peer(vector_get(peers, i));
+				if (n < 0) {
+					fprintf(stderr, "router closed the connection\n");
+					expected = forwarded;
+					break;
+				}
+				if (n > 0) {
+					forwarded += n;
+					end = now_sec();
+				}
+			}
+		}
+	}
+
+	printf("%ld LSPs sent, %ld of %ld flooded copies received in %.3fs: %.0f LSPs/s\n",
+		sent, forwarded, count * (long) peers->length, end - start,
+		end > start ? forwarded / (double) peers->length / (end - start) : 0.0);
+	fflush(stdout);
+
+	// Ask the router to exit so it reports its own CPU time
+	if (write(router_stdin, "exit\n", 5) < 0) {
+		perror("write");
+	}
+	close(router_stdin);
+	waitpid(pid, &status, 0);
+
+	for (i = 0; i < peers->length; ++i) {
+		bench_peer_t *peer = vector_get(peers, i);
+		close(peer->sock);
+	}
+	free(fds);
+	destroy_vector(peers);
+
+	return EXIT_SUCCESS;
+}
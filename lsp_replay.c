@@ -0,0 +1,203 @@
+/*
+ * lsp_replay.c
+ *
+ * Replays an LSP trace captured with routed_LS -t through the router core
+ * in a single thread, as fast as it will go. Reports LSPs per second and
+ * where the time went, then checks that the routing table it ends up with
+ * is the one the live router exited with.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "vector.h"
+#include "lsdb.h"
+#include "router.h"
+#include "trace.h"
+
+#define USAGE "[-m] <trace file> [log file]"
+#define ARG_MIN 2
+
+double now_sec() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Returns 1 if both tables hold the same routes. The order may differ if
+   the replay computes routes differently from the live router. */
+int table_matches(vector_p table, vector_p expected) {
+	unsigned int i;
+	if (table->length != expected->length) {
+		return 0;
+	}
+	for (i = 0; i < expected->length; ++i) {
+		table_entry_t *entry = vector_get(expected, i);
+		table_entry_t *found = table_get_by_id(table, entry->dest_id);
+		if (found == NULL || memcmp(found, entry, sizeof(table_entry_t)) != 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int main(int argc, char *argv[]) {
+	trace_p trace;
+	trace_record_t rec;
+	router_t router;
+	void *data;
+	vector_p expected = NULL;
+	unsigned long num_lsps = 0;
+	unsigned long num_costs = 0;
+	unsigned long flooded = 0;
+	double start;
+	double elapsed;
+	double other;
+	char *log_filename = "/dev/null";
+	int dense_spf = 0;
+	int killed = 0;
+	int retval;
+	int opt;
+	unsigned int i;
+
+	while ((opt = getopt(argc, argv, "m")) != -1) {
+		switch (opt) {
+		case 'm':
+			dense_spf = 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s %s\n", argv[0], USAGE);
+			return EXIT_FAILURE;
+		}
+	}
+	if (argc - optind < ARG_MIN - 1) {
+		fprintf(stderr, "Usage: %s %s\n", argv[0], USAGE);
+		return EXIT_FAILURE;
+	}
+	if (argc - optind > 1) {
+		log_filename = argv[optind + 1];
+	}
+
+	if ((trace = load_trace(argv[optind])) == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	// Set the router up the way routed_LS does, minus the sockets
+	memset(&router, '\0', sizeof(router));
+	router.id = trace->router_id;
+	router.neighbors = create_vector();
+	router.link_areas = trace->areas;
+	router.members = trace->members;
+	create_tables(&router);
+	for (i = 0; i < trace->neighbors->length; ++i) {
+		table_entry_t *entry = vector_get(trace->neighbors, i);
+		vector_add(router.neighbors, entry, sizeof(table_entry_t));
+		vector_add(router.routing_table, entry, sizeof(table_entry_t));
+	}
+	router.timed = 1;
+	if (dense_spf) {
+		router.dense = create_spf_dense();
+	}
+	if ((router.logfp = fopen(log_filename, "w")) == NULL) {
+		perror("fopen");
+		return EXIT_FAILURE;
+	}
+	create_areas(&router);
+
+	start = now_sec();
+	while ((retval = trace_next(trace, &rec, &data)) > 0) {
+		time_t when = rec.time / 1000000;
+
+		if (rec.type == TRACE_TABLE) {
+			// The live table was aged to this time before it was recorded,
+			// so anything that expired since the last LSP has to go here too
+			age_lsdb(&router, when);
+			if (expected != NULL) {
+				destroy_vector(expected);
+			}
+			expected = create_vector();
+			for (i = 0; i < rec.len / sizeof(table_entry_t); ++i) {
+				vector_add(expected, (table_entry_t *) data + i, sizeof(table_entry_t));
+			}
+			continue;
+		} else if (killed) {
+			continue;
+		}
+
+		age_lsdb(&router, when);
+
+		if (rec.type == TRACE_LSP) {
+			lsp_packet_t *packet = data;
+			char ignore_id[MAX_ID_LEN];
+			int action = handle_lsp(&router, packet, ignore_id, when);
+
+			// Count the copies sendall() would make
+			if (action & LSP_FORWARD) {
+				for (i = 0; i < router.neighbors->length; ++i) {
+					table_entry_t *entry = vector_get(router.neighbors, i);
+					if (link_floods(&router, i, packet) && strncmp(entry->dest_id, ignore_id, MAX_ID_LEN) != 0) {
+						++flooded;
+					}
+				}
+			}
+			if (action & LSP_KILL) {
+				killed = 1;
+			}
+			++num_lsps;
+
+		} else if (rec.type == TRACE_COST) {
+			lsp_entry_t *entry = data;
+			entry->id[MAX_ID_LEN - 1] = '\0';
+			set_link_cost(&router, entry->id, entry->cost);
+			++num_costs;
+		}
+	}
+	elapsed = now_sec() - start;
+
+	if (retval < 0) {
+		fprintf(stderr, "%s is truncated, replayed what was there\n", argv[optind]);
+	}
+
+	other = elapsed - router.timing.dedup - router.timing.route - router.timing.log;
+	printf("%s: replayed %lu LSPs and %lu cost changes in %.3fs: %.0f LSPs/s\n",
+		router.id, num_lsps, num_costs, elapsed, elapsed > 0 ? num_lsps / elapsed : 0.0);
+	if (num_lsps > 0) {
+		printf("  dedup %8.3fs %8.2fus/LSP\n", router.timing.dedup, router.timing.dedup * 1e6 / num_lsps);
+		printf("  route %8.3fs %8.2fus/LSP, %lu computations\n", router.timing.route,
+			router.timing.route * 1e6 / num_lsps, router.recomputes);
+		printf("  log   %8.3fs %8.2fus/LSP\n", router.timing.log, router.timing.log * 1e6 / num_lsps);
+		printf("  other %8.3fs %8.2fus/LSP\n", other, other * 1e6 / num_lsps);
+		printf("  %lu copies flooded\n", flooded);
+	}
+
+	// Compare against the table the live router exited with
+	retval = EXIT_SUCCESS;
+	if (expected == NULL) {
+		printf("no final routing table in trace, nothing to verify\n");
+	} else if (table_matches(router.routing_table, expected)) {
+		printf("routing table matches the live run (%zu routes)\n", expected->length);
+	} else {
+		printf("routing table DIFFERS from the live run\n");
+		printf("live:\n");
+		log_table(stdout, expected);
+		printf("replay:\n");
+		log_table(stdout, router.routing_table);
+		retval = EXIT_FAILURE;
+	}
+
+	if (expected != NULL) {
+		destroy_vector(expected);
+	}
+	destroy_areas(&router);
+	destroy_vector(router.neighbors);
+	destroy_tables(&router);
+	if (router.dense != NULL) {
+		destroy_spf_dense(router.dense);
+	}
+	fclose(router.logfp);
+	destroy_trace(trace);
+
+	return retval;
+}
@@ -0,0 +1,64 @@
+#include "pool.h"
+#include <stddef.h>
+
+/* Every slab starts with a link to the previous one, padded so the objects
+   after it stay aligned */
+typedef union slab_header{
+	void* next;
+	max_align_t align;
+} slab_header_t;
+
+pool_p create_pool(size_t obj_size, size_t per_slab){
+	pool_p p = (pool_p)malloc(sizeof(struct pool));
+	size_t align = sizeof(max_align_t);
+	if(obj_size < sizeof(void*))
+		obj_size = sizeof(void*);
+	p->obj_size = (obj_size + align - 1) / align * align;
+	p->per_slab = per_slab > 0 ? per_slab : 1;
+	p->free_list = NULL;
+	p->slabs = NULL;
+	p->num_slabs = 0;
+	p->in_use = 0;
+	return p;
+}
+
+static void pool_grow(pool_p p){
+	slab_header_t* slab = (slab_header_t*)malloc(sizeof(slab_header_t) +
+					p->obj_size * p->per_slab);
+	char* obj = (char*)(slab + 1);
+	size_t i;
+
+	slab->next = p->slabs;
+	p->slabs = slab;
+	p->num_slabs++;
+	for(i=0; i<p->per_slab; ++i){
+		*(void**)obj = p->free_list;
+		p->free_list = obj;
+		obj += p->obj_size;
+	}
+}
+
+void* pool_get(pool_p p){
+	void* obj;
+	if(p->free_list == NULL)
+		pool_grow(p);
+	obj = p->free_list;
+	p->free_list = *(void**)obj;
+	p->in_use++;
+	return obj;
+}
+
+void pool_put(pool_p p, void* obj){
+	*(void**)obj = p->free_list;
+	p->free_list = obj;
+	p->in_use--;
+}
+
+void destroy_pool(pool_p p){
+	while(p->slabs != NULL){
+		slab_header_t* slab = (slab_header_t*)p->slabs;
+		p->slabs = slab->next;
+		free(slab);
+	}
+	free(p);
+}
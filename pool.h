@@ -0,0 +1,36 @@
+#ifndef __LIBDS_POOL_H__
+#define __LIBDS_POOL_H__
+
+/* A pool of fixed size objects carved out of larger slabs. Objects that
+   are put back go on a free list and are handed out again, so once a pool
+   has grown to its working size getting and putting objects never touches
+   the heap. Slabs are only returned when the pool is destroyed. */
+
+#include <stdlib.h>
+
+struct pool{
+	size_t obj_size;
+	size_t per_slab;
+	void* free_list;
+	void* slabs;
+	size_t num_slabs;
+	size_t in_use;
+};
+
+typedef struct pool * pool_p;
+
+/* Create a pool of objects of obj_size bytes, allocated per_slab at a time.
+   Objects are aligned for any type. The pool must be eventually destroyed
+   by a call to destroy_pool() to avoid memory leaks. */
+pool_p create_pool(size_t obj_size, size_t per_slab);
+
+/* Get an object from the pool. Its contents are undefined. */
+void* pool_get(pool_p p);
+
+/* Return an object obtained from pool_get() to the pool */
+void pool_put(pool_p p, void* obj);
+
+/* Free every slab of the pool, including objects still in use */
+void destroy_pool(pool_p p);
+
+#endif
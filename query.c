@@ -0,0 +1,303 @@
+#define _GNU_SOURCE
+
+#include "query.h"
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define QUERY_BUF_SIZE 65536
+#define QUERY_MAX_OUT (1 << 18)
+#define QUERY_BUDGET 8192  // Lookups per client per poll
+#define QUERY_MAX_EVENTS 64
+
+typedef struct query_client {
+	int sock;
+	uint32_t events;  // What epoll is watching for
+	int dead;
+	size_t in_len;
+	char in[QUERY_BUF_SIZE];
+	char *out;
+	size_t out_off;
+	size_t out_len;
+	size_t out_cap;
+	struct query_client *next;
+} query_client_t;
+
+/* FNV-1a over an ID that may fill all MAX_ID_LEN bytes */
+static unsigned int query_hash(const char *id){
+	unsigned int h = 2166136261u;
+	int i;
+	for(i = 0; i < MAX_ID_LEN && id[i] != '\0'; ++i)
+		h = (h ^ (unsigned char)id[i]) * 16777619u;
+	return h;
+}
+
+static table_entry_t* query_lookup(query_p q, const char *id){
+	unsigned int i;
+	int slot;
+
+	if(q->slots == NULL)
+		return NULL;
+	for(i = query_hash(id) & q->mask; (slot = q->slots[i]) >= 0; i = (i + 1) & q->mask){
+		if(strncmp(q->routes[slot].dest_id, id, MAX_ID_LEN) == 0)
+			return &q->routes[slot];
+	}
+	return NULL;
+}
+
+query_p create_query(char *path){
+	struct sockaddr_un addr;
+	struct epoll_event ev;
+	query_p q;
+	int sock;
+	int epfd;
+
+	memset(&addr, '\0', sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(strlen(path) >= sizeof(addr.sun_path)){
+		fprintf(stderr, "Socket path too long: %s\n", path);
+		return NULL;
+	}
+	strcpy(addr.sun_path, path);
+
+	if((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0){
+		perror("socket");
+		return NULL;
+	}
+	unlink(path);
+	if(bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0){
+		perror("bind");
+		close(sock);
+		return NULL;
+	}
+	if(listen(sock, 64) != 0){
+		perror("listen");
+		close(sock);
+		unlink(path);
+		return NULL;
+	}
+	fcntl(sock, F_SETFL, O_NONBLOCK);
+
+	if((epfd = epoll_create1(0)) < 0){
+		perror("epoll_create1");
+		close(sock);
+		unlink(path);
+		return NULL;
+	}
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &ev);
+
+	q = (query_p)calloc(1, sizeof(struct query));
+	q->sock = sock;
+	q->epfd = epfd;
+	q->path = strdup(path);
+	return q;
+}
+
+int query_fd(query_p q){
+	return q->epfd;
+}
+
+void query_update(query_p q, vector_p table){
+	unsigned int size = 16;
+	unsigned int i;
+
+	while(size < table->length * 2)
+		size *= 2;
+
+	q->routes = (table_entry_t*)realloc(q->routes, sizeof(table_entry_t) * (table->length + 1));
+	q->slots = (int*)realloc(q->slots, sizeof(int) * size);
+	q->mask = size - 1;
+	q->num_routes = table->length;
+	memset(q->slots, 0xff, sizeof(int) * size);
+
+	for(i = 0; i < table->length; ++i){
+		unsigned int h;
+		memcpy(&q->routes[i], vector_get(table, i), sizeof(table_entry_t));
+		for(h = query_hash(q->routes[i].dest_id) & q->mask; q->slots[h] >= 0; h = (h + 1) & q->mask)
+			;
+		q->slots[h] = i;
+	}
+}
+
+static void query_accept(query_p q){
+	struct epoll_event ev;
+	int sock;
+
+	while((sock = accept4(q->sock, NULL, NULL, SOCK_NONBLOCK)) >= 0){
+		query_client_t *c = (query_client_t*)calloc(1, sizeof(query_client_t));
+		c->sock = sock;
+		c->events = EPOLLIN;
+		ev.events = c->events;
+		ev.data.ptr = c;
+		epoll_ctl(q->epfd, EPOLL_CTL_ADD, sock, &ev);
+		c->next = q->clients;
+		q->clients = c;
+	}
+	if(errno != EAGAIN && errno != EWOULDBLOCK)
+		perror("accept");
+}
+
+static void query_read(query_client_t *c){
+	ssize_t n = recv(c->sock, c->in + c->in_len, QUERY_BUF_SIZE - c->in_len, 0);
+	if(n > 0){
+		c->in_len += n;
+	} else if(n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)){
+		c->dead = 1;
+	}
+}
+
+static void query_flush(query_client_t *c){
+	while(c->out_off < c->out_len){
+		ssize_t n = send(c->sock, c->out + c->out_off, c->out_len - c->out_off,
+						MSG_DONTWAIT | MSG_NOSIGNAL);
+		if(n < 0){
+			if(errno != EAGAIN && errno != EWOULDBLOCK)
+				c->dead = 1;
+			return;
+		}
+		c->out_off += n;
+	}
+	c->out_off = c->out_len = 0;
+}
+
+/* Answer complete requests in the client's input buffer, up to the budget.
+   Returns 1 if a complete request is left over. */
+static int query_process(query_p q, query_client_t *c){
+	unsigned int budget = QUERY_BUDGET;
+	size_t off = 0;
+	int more = 0;
+
+	while(c->out_len - c->out_off < QUERY_MAX_OUT){
+		query_header_t header;
+		query_reply_t *reply;
+		size_t need;
+		size_t reply_len;
+		unsigned int i;
+
+		if(c->in_len - off < sizeof(query_header_t))
+			break;
+		memcpy(&header, c->in + off, sizeof(header));
+		if(header.count > QUERY_MAX_BATCH){
+			c->dead = 1;
+			break;
+		}
+		need = sizeof(query_header_t) + (size_t)header.count * MAX_ID_LEN;
+		if(c->in_len - off < need)
+			break;
+		if(header.count > budget){
+			more = 1;
+			break;
+		}
+
+		reply_len = sizeof(query_header_t) + sizeof(query_reply_t) * header.count;
+		if(c->out_len + reply_len > c->out_cap){
+			if(c->out_off > 0){
+				memmove(c->out, c->out + c->out_off, c->out_len - c->out_off);
+				c->out_len -= c->out_off;
+				c->out_off = 0;
+			}
+			while(c->out_len + reply_len > c->out_cap)
+				c->out_cap = c->out_cap ? c->out_cap * 2 : QUERY_BUF_SIZE;
+			c->out = (char*)realloc(c->out, c->out_cap);
+		}
+
+		memcpy(c->out + c->out_len, &header, sizeof(header));
+		reply = (query_reply_t*)(c->out + c->out_len + sizeof(header));
+		for(i = 0; i < header.count; ++i){
+			table_entry_t *entry = query_lookup(q,
+						c->in + off + sizeof(query_header_t) + (size_t)i * MAX_ID_LEN);
+			if(entry != NULL){
+				reply[i].found = 1;
+				reply[i].cost = entry->cost;
+				reply[i].out_port = entry->out_port;
+				reply[i].dest_port = entry->dest_port;
+			} else {
+				memset(&reply[i], 0, sizeof(query_reply_t));
+			}
+		}
+		c->out_len += reply_len;
+		off += need;
+		budget -= header.count;
+		q->lookups += header.count;
+	}
+
+	if(off > 0){
+		memmove(c->in, c->in + off, c->in_len - off);
+		c->in_len -= off;
+	}
+	return more;
+}
+
+static void destroy_query_client(query_client_t *c){
+	close(c->sock);
+	free(c->out);
+	free(c);
+}
+
+int query_poll(query_p q){
+	struct epoll_event events[QUERY_MAX_EVENTS];
+	query_client_t **link = &q->clients;
+	query_client_t *c;
+	int busy = 0;
+	int n;
+	int i;
+
+	n = epoll_wait(q->epfd, events, QUERY_MAX_EVENTS, 0);
+	for(i = 0; i < n; ++i){
+		if(events[i].data.ptr == NULL){
+			query_accept(q);
+		} else if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)){
+			query_read((query_client_t*)events[i].data.ptr);
+		}
+	}
+
+	while((c = *link) != NULL){
+		uint32_t want;
+
+		if(!c->dead){
+			busy |= query_process(q, c);
+			query_flush(c);
+		}
+		if(c->dead){
+			*link = c->next;
+			destroy_query_client(c);
+			continue;
+		}
+
+		// Stop reading while the input buffer is full, wait to write while
+		// replies are backed up
+		want = (c->in_len < QUERY_BUF_SIZE ? EPOLLIN : 0) |
+				(c->out_off < c->out_len ? EPOLLOUT : 0);
+		if(want != c->events){
+			struct epoll_event ev;
+			ev.events = want;
+			ev.data.ptr = c;
+			epoll_ctl(q->epfd, EPOLL_CTL_MOD, c->sock, &ev);
+			c->events = want;
+		}
+		link = &c->next;
+	}
+	return busy;
+}
+
+void destroy_query(query_p q){
+	while(q->clients != NULL){
+		query_client_t *c = q->clients;
+		q->clients = c->next;
+		destroy_query_client(c);
+	}
+	close(q->epfd);
+	close(q->sock);
+	unlink(q->path);
+	free(q->path);
+	free(q->routes);
+	free(q->slots);
+	free(q);
+}
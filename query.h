@@ -0,0 +1,68 @@
+#ifndef __QUERY_H__
+#define __QUERY_H__
+
+/* Route query service. Local processes connect to a Unix domain socket and
+   look up the next hop and cost for destination IDs in batches. Requests
+   may be pipelined; replies come back in order.
+
+   A request is a query_header_t followed by count IDs of MAX_ID_LEN bytes
+   each. Its reply is a query_header_t with the same count and tag followed
+   by count query_reply_t, in the same order as the IDs. Everything is in
+   host byte order and count may be at most QUERY_MAX_BATCH.
+
+   Lookups are answered from a hash index of the routing table that is
+   rebuilt whenever the table changes. Each call to query_poll() does a
+   bounded amount of work, so queries never hold up flooding. */
+
+#include <stdint.h>
+#include "vector.h"
+#include "spf.h"
+
+#define QUERY_MAX_BATCH 1024
+
+typedef struct {
+	uint32_t count;
+	uint32_t tag;  // Echoed back in the reply
+} query_header_t;
+
+typedef struct {
+	uint32_t found;
+	uint32_t cost;
+	uint32_t out_port;
+	uint32_t dest_port;
+} query_reply_t;
+
+struct query_client;
+
+struct query{
+	int sock;
+	int epfd;
+	char *path;
+	table_entry_t *routes;  // Copy of the routing table
+	unsigned int num_routes;
+	int *slots;             // Open addressing index into routes
+	unsigned int mask;
+	struct query_client *clients;
+	unsigned long lookups;
+};
+
+typedef struct query * query_p;
+
+/* Start listening for clients on the Unix socket at path. Returns NULL on
+   failure. It must be destroyed by destroy_query(). */
+query_p create_query(char *path);
+
+/* Get a descriptor that becomes readable when query_poll() has work */
+int query_fd(query_p q);
+
+/* Rebuild the lookup index from table, a vector of table_entry_t */
+void query_update(query_p q, vector_p table);
+
+/* Accept clients, answer requests and write replies without blocking.
+   Returns 1 if requests are left over for the next call, 0 otherwise. */
+int query_poll(query_p q);
+
+/* Disconnect every client and remove the socket */
+void destroy_query(query_p q);
+
+#endif
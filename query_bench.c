@@ -0,0 +1,254 @@
+/*
+ * query_bench.c
+ *
+ * Load generator for a router's route query socket. Looks up every router
+ * named in the initialization file over and over, keeping depth batches in
+ * flight on one connection, and reports lookups per second along with the
+ * median and 99th percentile batch latency.
+ */
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include "query.h"
+
+#define USAGE "<query socket> <initialization file> [batch] [depth] [seconds]"
+#define ARG_MIN 3
+#define DEFAULT_BATCH 64
+#define DEFAULT_DEPTH 8
+#define DEFAULT_SECONDS 5
+#define MAX_DEPTH 1024
+#define IDLE_TIMEOUT_MS 5000
+
+double now_sec() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Adds id to ids unless it is already there */
+void add_id(vector_p ids, char *id) {
+	char buf[MAX_ID_LEN];
+	unsigned int i;
+
+	for (i = 0; i < ids->length; ++i) {
+		if (strncmp(vector_get(ids, i), id, MAX_ID_LEN) == 0) {
+			return;
+		}
+	}
+	memset(buf, '\0', sizeof(buf));
+	strncpy(buf, id, MAX_ID_LEN - 1);
+	vector_add(ids, buf, sizeof(buf));
+}
+
+/* Collects every router ID named in the initialization file */
+void read_ids(FILE *fp, vector_p ids) {
+	char *line = NULL;
+	size_t len = 0;
+	char *str;
+
+	while (getline(&line, &len, fp) != -1) {
+		if ((str = strtok(line, " ,<>\n")) == NULL) {
+			continue;
+		}
+		add_id(ids, str);
+		if (strtok(NULL, " ,<>\n") != NULL && (str = strtok(NULL, " ,<>\n")) != NULL) {
+			add_id(ids, str);
+		}
+	}
+	free(line);
+}
+
+int compare_double(const void *a, const void *b) {
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+int main(int argc, char *argv[]) {
+	struct sockaddr_un addr;
+	struct pollfd pfd;
+	FILE *initfp;
+	vector_p ids;
+	char *request;
+	char *reply;
+	size_t request_len;
+	size_t reply_len;
+	size_t tx_off;
+	size_t rx_len = 0;
+	double sent_at[MAX_DEPTH];
+	double *latency;
+	unsigned long num_latency = 0;
+	unsigned long max_latency = 4096;
+	unsigned long lookups = 0;
+	unsigned long found = 0;
+	unsigned int batch = DEFAULT_BATCH;
+	unsigned int depth = DEFAULT_DEPTH;
+	double seconds = DEFAULT_SECONDS;
+	unsigned int sent = 0;
+	unsigned int recvd = 0;
+	unsigned int next_id = 0;
+	unsigned int i;
+	double start;
+	double end;
+	int sock;
+
+	if (argc < ARG_MIN) {
+		fprintf(stderr, "Usage: %s %s\n", argv[0], USAGE);
+		return EXIT_FAILURE;
+	}
+	if (argc > 3) {
+		batch = atoi(argv[3]);
+	}
+	if (argc > 4) {
+		depth = atoi(argv[4]);
+	}
+	if (argc > 5) {
+		seconds = atof(argv[5]);
+	}
+	if (batch < 1 || batch > QUERY_MAX_BATCH || depth < 1 || depth > MAX_DEPTH) {
+		fprintf(stderr, "batch must be 1-%d and depth 1-%d\n", QUERY_MAX_BATCH, MAX_DEPTH);
+		return EXIT_FAILURE;
+	}
+
+	if ((initfp = fopen(argv[2], "r")) == NULL) {
+		fprintf(stderr, "Error opening file: %s\n", argv[2]);
+		perror("fopen");
+		return EXIT_FAILURE;
+	}
+	ids = create_vector();
+	read_ids(initfp, ids);
+	fclose(initfp);
+	if (ids->length == 0) {
+		fprintf(stderr, "No router IDs in %s\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+
+	memset(&addr, '\0', sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, argv[1], sizeof(addr.sun_path) - 1);
+	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		perror("socket");
+		return EXIT_FAILURE;
+	}
+	if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		perror("connect");
+		return EXIT_FAILURE;
+	}
+	fcntl(sock, F_SETFL, O_NONBLOCK);
+
+	request_len = sizeof(query_header_t) + (size_t) batch * MAX_ID_LEN;
+	reply_len = sizeof(query_header_t) + (size_t) batch * sizeof(query_reply_t);
+	request = malloc(request_len);
+	reply = malloc(reply_len);
+	latency = malloc(sizeof(double) * max_latency);
+	tx_off = request_len;
+
+	pfd.fd = sock;
+	start = now_sec();
+	end = start + seconds;
+
+	// Stop sending once time is up, then collect the outstanding replies
+	while (recvd < sent || now_sec() < end) {
+		int retval;
+
+		pfd.events = POLLIN;
+		if (tx_off < request_len || (sent - recvd < depth && now_sec() < end)) {
+			pfd.events |= POLLOUT;
+		}
+		if ((retval = poll(&pfd, 1, IDLE_TIMEOUT_MS)) < 0) {
+			perror("poll");
+			break;
+		} else if (retval == 0) {
+			fprintf(stderr, "timed out waiting for router\n");
+			break;
+		}
+
+		if (pfd.revents & POLLOUT) {
+			ssize_t n;
+			if (tx_off == request_len) {
+				query_header_t *header = (query_header_t *) request;
+				header->count = batch;
+				header->tag = sent;
+				for (i = 0; i < batch; ++i) {
+					memcpy(request + sizeof(query_header_t) + (size_t) i * MAX_ID_LEN,
+						vector_get(ids, next_id), MAX_ID_LEN);
+					next_id = (next_id + 1) % ids->length;
+				}
+				sent_at[sent % depth] = now_sec();
+				++sent;
+				tx_off = 0;
+			}
+			n = send(sock, request + tx_off, request_len - tx_off, MSG_NOSIGNAL);
+			if (n < 0) {
+				if (errno != EAGAIN && errno != EWOULDBLOCK) {
+					perror("send");
+					break;
+				}
+			} else {
+				tx_off += n;
+			}
+		}
+
+		if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+			ssize_t n = recv(sock, reply + rx_len, reply_len - rx_len, 0);
+			if (n == 0) {
+				fprintf(stderr, "router closed the connection\n");
+				break;
+			} else if (n < 0) {
+				if (errno != EAGAIN && errno != EWOULDBLOCK) {
+					perror("recv");
+					break;
+				}
+				continue;
+			}
+			rx_len += n;
+			if (rx_len < reply_len) {
+				continue;
+			}
+
+			// Replies come back in order, so this one answers batch recvd
+			query_header_t *header = (query_header_t *) reply;
+			query_reply_t *replies = (query_reply_t *) (reply + sizeof(query_header_t));
+			if (header->tag != recvd || header->count != batch) {
+				fprintf(stderr, "unexpected reply %u to request %u\n", header->tag, recvd);
+				break;
+			}
+			for (i = 0; i < batch; ++i) {
+				found += replies[i].found;
+			}
+			if (num_latency == max_latency) {
+				max_latency *= 2;
+				latency = realloc(latency, sizeof(double) * max_latency);
+			}
+			latency[num_latency++] = now_sec() - sent_at[recvd % depth];
+			lookups += batch;
+			++recvd;
+			rx_len = 0;
+		}
+	}
+	end = now_sec();
+
+	qsort(latency, num_latency, sizeof(double), compare_double);
+	printf("%lu lookups (%lu found) in %.3fs: %.0f lookups/s\n",
+		lookups, found, end - start, end > start ? lookups / (end - start) : 0.0);
+	if (num_latency > 0) {
+		printf("batch of %u, %u in flight: p50 %.1fus, p99 %.1fus\n", batch, depth,
+			latency[num_latency / 2] * 1e6, latency[(num_latency * 99) / 100] * 1e6);
+	}
+
+	close(sock);
+	free(request);
+	free(reply);
+	free(latency);
+	destroy_vector(ids);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,95 @@
+/*
+ * route_watch.c
+ *
+ * Example route change feed subscriber. Connects to a router's feed socket,
+ * keeps its own copy of the routing table up to date from the snapshot and
+ * deltas it receives, and prints every change.
+ */
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "hashmap.h"
+#include "feed.h"
+
+#define USAGE "<feed socket>"
+#define ARG_MIN 2
+
+/* Reads exactly len bytes. Returns 0 on success, -1 on EOF or error. */
+int read_full(int sock, void *buf, size_t len) {
+	char *p = buf;
+	while (len > 0) {
+		ssize_t n = read(sock, p, len);
+		if (n <= 0) {
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	struct sockaddr_un addr;
+	hashmap_p routes;
+	feed_header_t header;
+	feed_route_t route;
+	const char *ops[] = { "", "ADD", "REMOVE", "CHANGE" };
+	int sock;
+	unsigned int i;
+
+	if (argc < ARG_MIN) {
+		fprintf(stderr, "Usage: %s %s\n", argv[0], USAGE);
+		return EXIT_FAILURE;
+	}
+
+	memset(&addr, '\0', sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, argv[1], sizeof(addr.sun_path) - 1);
+
+	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		perror("socket");
+		return EXIT_FAILURE;
+	}
+	if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		perror("connect");
+		return EXIT_FAILURE;
+	}
+
+	routes = create_hashmap();
+
+	while (read_full(sock, &header, sizeof(header)) == 0) {
+		if (header.type == FEED_SNAPSHOT) {
+			destroy_hashmap(routes);
+			routes = create_hashmap();
+			printf("SNAPSHOT version %llu, %u routes\n", (unsigned long long) header.version, header.count);
+		} else {
+			printf("DELTA version %llu, %u changes\n", (unsigned long long) header.version, header.count);
+		}
+
+		for (i = 0; i < header.count; ++i) {
+			if (read_full(sock, &route, sizeof(route)) < 0) {
+				break;
+			}
+			route.dest_id[MAX_ID_LEN - 1] = '\0';
+			if (route.op == FEED_REMOVE) {
+				hashmap_remove(routes, route.dest_id);
+			} else {
+				hashmap_put(routes, route.dest_id, &route, sizeof(route));
+			}
+			if (route.op >= FEED_ADD && route.op <= FEED_CHANGE) {
+				printf("  %-6s %s | %4u | %8u | %9u\n", ops[route.op], route.dest_id,
+					route.cost, route.out_port, route.dest_port);
+			}
+		}
+		printf("  %lu routes\n", (unsigned long) routes->size);
+		fflush(stdout);
+	}
+
+	destroy_hashmap(routes);
+	close(sock);
+	return EXIT_SUCCESS;
+}
@@ -5,9 +5,12 @@
  *      Author: Ben Cavins 
  */
 
+#define _GNU_SOURCE
+
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
@@ -16,81 +19,32 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <time.h>
 #include <errno.h>
 #include <limits.h>
 #include "vector.h"
 #include "hashmap.h"
-
-#define USAGE "<router ID> <log file name> <initialization file>"
+#include "lsp.h"
+#include "router.h"
+#include "feed.h"
+#include "query.h"
+#include "trace.h"
+#include "uring.h"
+#include "pool.h"
+#include "alloc_count.h"
+
+#define USAGE "[-u] [-m] [-f feed socket] [-q query socket] [-t trace file] <router ID> <log file name> <initialization file>"
 #define ARG_MIN 3
-#define MAX_ID_LEN 24
 #define MAX_PORT_LEN 16
-#define MAX_LSP_ENTRIES 64
-#define TTL 6
-#define FLAG_KILL 1
-
-typedef struct {
-	char dest_id[MAX_ID_LEN];
-	unsigned int cost;
-	unsigned int out_port;
-	unsigned int dest_port;
-} table_entry_t;
-
-typedef struct {
-	int seq_num;
-	char src_id[MAX_ID_LEN];
-	int flags;
-	int length;
-	int entries;
-	int ttl;
-} lsp_header_t;
-
-typedef struct {
-	char id[MAX_ID_LEN];
-	int cost;
-} lsp_entry_t;
-
-typedef struct {
-	lsp_header_t header;
-	lsp_entry_t data[MAX_LSP_ENTRIES];
-} lsp_packet_t;
-
-void init_router(FILE* fp, char *router_id, vector_p neighbors, vector_p table) {
-
-	char *line = NULL;  // Current line
-	size_t len = 0;     // Buffer length
-	ssize_t read;       // Bytes read
-	char *str;          // Current string
-
-	// Read line in file
-	while ((read = getline(&line, &len, fp)) != -1) {
-
-		// Parse for router ID
-		str = strtok(line, " ,<>\n");
-
-		// Only parse line fully if direct neighbor of router ID
-		if (strncmp(str, router_id, MAX_ID_LEN) == 0) {
-			char *port1 = strtok(NULL, " ,<>\n");
-			char *node  = strtok(NULL, " ,<>\n");
-			char *port2 = strtok(NULL, " ,<>\n");
-			char *cost  = strtok(NULL, " ,<>\n");
-
-			if (port1 != NULL && node != NULL && port2 != NULL && cost != NULL) {
-				table_entry_t entry;
-				strncpy(entry.dest_id, node, MAX_ID_LEN);
-				entry.out_port = atoi(port1);
-				entry.dest_port = atoi(port2);
-				entry.cost = atoi(cost);
-				vector_add(neighbors, &entry, sizeof(entry));
-				vector_add(table, &entry, sizeof(entry));
-			}
-		}
-	}
-
-	// Free memory
-	free(line);
-}
+#define RECV_PACKETS 4
+#define CMD_BUF_SIZE 256
+#define URING_ENTRIES 256
+#define URING_BUFFERS 256
+#define URING_MAX_CHAIN 32  // No more than URING_ENTRIES, chains are reserved whole
+#define LOG_BUF_SIZE 65536
+#define LOG_CHUNK_SIZE 4096  // Log writes up to this size come from a pool
+#define POOL_SLAB 64
 
 void build_socks_map(hashmap_p map, vector_p neighbors) {
 	struct sockaddr_in local_addr;
@@ -167,157 +121,633 @@ void build_socks_map(hashmap_p map, vector_p neighbors) {
 	destroy_vector(listening);
 }
 
-lsp_header_t build_header(int seq_num, char *src_id, int flags, int length, int entries, int ttl) {
-	lsp_header_t header;
-	header.seq_num = seq_num;
-	strncpy(header.src_id, src_id, MAX_ID_LEN);
-	header.flags = flags;
-	header.length = length;
-	header.entries = entries;
-	header.ttl = ttl;
-	return header;
+void sendall(router_t *r, lsp_packet_t *packet, char *ignore_id) {
+	unsigned int i;
+	for (i = 0; i < r->neighbors->length; ++i) {
+		table_entry_t *entry = vector_get(r->neighbors, i);
+		if (!link_floods(r, i, packet)) {
+			continue;
+		}
+		if (ignore_id == NULL || strncmp(entry->dest_id, ignore_id, MAX_ID_LEN) != 0) {
+			int *sock = hashmap_get(r->socks, entry->dest_id);
+			if (send(*sock, packet, packet->header.length, 0) < 0) {
+				perror("send");
+			}
+		}
+	}
 }
 
-/* Returns 1 if table contains id, 0 otherwise */
-int table_contains(vector_p table, char *id) {
-	unsigned int i;
-	for (i = 0; i < table->length; ++i) {
-		table_entry_t *entry = vector_get(table, i);
-		if (strncmp(id, entry->dest_id, MAX_ID_LEN) == 0) {
-			return 1;
+/* Runs one command line. Returns LSP_KILL if the router should exit. */
+int handle_command(router_t *r, char *cmd) {
+	char id[MAX_ID_LEN];
+	int cost;
+
+	if (strncmp(cmd, "exit", 4) == 0) {
+		return LSP_KILL;
+	} else if (sscanf(cmd, "cost %23s %d", id, &cost) == 2) {
+		if (r->trace != NULL) {
+			trace_cost(r->trace, id, cost);
+		}
+		if (set_link_cost(r, id, cost) < 0) {
+			fprintf(stderr, "%s: no link to %s\n", r->id, id);
+		}
+	} else if (sscanf(cmd, "down %23s", id) == 1 || sscanf(cmd, "up %23s", id) == 1) {
+		if (set_link_state(r, id, cmd[0] == 'u') < 0) {
+			fprintf(stderr, "%s: no link to %s\n", r->id, id);
+		} else if (r->trace != NULL) {
+			trace_cost(r->trace, id, table_get_by_id(r->neighbors, id)->cost);
 		}
 	}
 	return 0;
 }
 
-table_entry_t* table_get_by_id(vector_p table, char *id) {
-	unsigned int i;
-	for (i = 0; i < table->length; ++i) {
-		table_entry_t *entry = vector_get(table, i);
-		if (strncmp(entry->dest_id, id, MAX_ID_LEN) == 0) {
-			return entry;
+/* Returns the next of our fragments due to be sent, or NULL */
+lsp_packet_t* next_lsp(router_t *r) {
+	lsp_packet_t *packet = refresh_lsp(r, time(NULL));
+	if (packet != NULL && packet->header.fragment == 0) {
+		printf("%s: sending...\n", r->id);
+	}
+	return packet;
+}
+
+/* Reads and runs commands from stdin. Returns LSP_KILL if the router should
+   exit and -1 once stdin is closed. */
+int read_commands(router_t *r) {
+	char buf[CMD_BUF_SIZE];
+	char *line;
+	char *save;
+	ssize_t n;
+
+	if ((n = read(fileno(stdin), buf, sizeof(buf) - 1)) < 0) {
+		perror("read");
+		return -1;
+	} else if (n == 0) {
+		return -1;
+	}
+
+	buf[n] = '\0';
+	for (line = strtok_r(buf, "\n", &save); line != NULL; line = strtok_r(NULL, "\n", &save)) {
+		if (handle_command(r, line) == LSP_KILL) {
+			return LSP_KILL;
 		}
 	}
-	return NULL;
+	return 0;
 }
 
-int update_routing_table(vector_p table, lsp_packet_t *packet, char *id) {
-	int i;
-	int index;
-	int c;
-	int out_port;
-	int dest_port;
-	table_entry_t *entry;
-	table_entry_t new_entry;
-	int changed = 0;
-	if (!table_contains(table, packet->header.src_id)) {
-		return 0;
-	}
-	entry = table_get_by_id(table, packet->header.src_id);
-	c = entry->cost;
-	out_port = entry->out_port;
-	dest_port = entry->dest_port;
-	for (i = 0; i < packet->header.entries; ++i) {
-		new_entry.cost = packet->data[i].cost + c;
-		strncpy(new_entry.dest_id, packet->data[i].id, MAX_ID_LEN);
-		new_entry.out_port = out_port;
-		new_entry.dest_port = dest_port;
-		if (strncmp(new_entry.dest_id, id, MAX_ID_LEN) != 0) {
-			if (!table_contains(table, packet->data[i].id)) {
-				vector_add(table, &new_entry, sizeof(table_entry_t));
-				changed = 1;
-			} else {
-				entry = table_get_by_id(table, packet->data[i].id);
-
-				// Replace if cost is less
-				if (new_entry.cost < entry->cost) {
-					index = vector_index(table, entry, sizeof(table_entry_t));
-					vector_set(table, index, &new_entry, sizeof(table_entry_t));
-					changed = 1;
-
-				// Replace if cost is same and ID is less
-				} else if (new_entry.cost == entry->cost) {
-					if (new_entry.dest_port < entry->dest_port) {
-						index = vector_index(table, entry, sizeof(table_entry_t));
-						vector_set(table, index, &new_entry, sizeof(table_entry_t));
-						changed = 1;
+/* Prints CPU use and, if counted, the heap allocations made since start */
+void print_stats(router_t *r, long start) {
+	struct rusage usage;
+	long allocs = alloc_count();
+	double cpu;
+	getrusage(RUSAGE_SELF, &usage);
+	cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+		usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+	printf("%s: %lu LSPs received, %.2fs CPU, %.0f LSPs/s/core\n",
+		r->id, r->lsps_recvd, cpu, cpu > 0 ? r->lsps_recvd / cpu : 0.0);
+	if (r->query != NULL) {
+		printf("%s: %lu route lookups answered\n", r->id, r->query->lookups);
+	}
+	if (allocs >= 0) {
+		printf("%s: %ld heap allocations, %.3f per LSP\n", r->id, allocs - start,
+			r->lsps_recvd > 0 ? (allocs - start) / (double) r->lsps_recvd : 0.0);
+	}
+}
+
+void run_select_loop(router_t *r) {
+	lsp_reader_t *readers = calloc(r->neighbors->length, sizeof(lsp_reader_t));
+	lsp_packet_t *packet;
+	unsigned int i;
+	int watch_stdin = 1;
+	int done = 0;
+
+	while (!done) {
+
+		while ((packet = next_lsp(r)) != NULL) {
+			sendall(r, packet, NULL);
+		}
+		age_lsdb(r, time(NULL));
+
+		if (r->feed != NULL) {
+			feed_accept(r->feed, r->routing_table);
+			feed_flush(r->feed);
+		}
+		if (r->query != NULL) {
+			query_poll(r->query);
+		}
+
+		for (i = 0; i < r->neighbors->length && !done; ++i) {
+			table_entry_t *entry = vector_get(r->neighbors, i);
+			int *sock = hashmap_get(r->socks, entry->dest_id);
+			lsp_packet_t buf[RECV_PACKETS];
+			int retval = recv(*sock, buf, sizeof(buf), O_NONBLOCK);
+			if (retval < 0) {
+				if (errno != EAGAIN && errno != EWOULDBLOCK) {
+					perror("recv");
+				}
+			} else if (retval > 0) {
+				char *data = (char *) buf;
+				size_t len = retval;
+				while ((packet = lsp_read(&readers[i], &data, &len)) != NULL) {
+					char ignore_id[MAX_ID_LEN];
+					int action;
+					if (r->trace != NULL) {
+						trace_lsp(r->trace, i, packet);
+					}
+					action = handle_lsp(r, packet, ignore_id, time(NULL));
+					if (action & LSP_FORWARD) {
+						sendall(r, packet, ignore_id);
+					}
+					if (action & LSP_KILL) {
+						done = 1;
+						break;
 					}
 				}
 			}
 		}
+
+		if (done || !watch_stdin) {
+			continue;
+		}
+
+		fd_set fdset;
+		struct timeval tv;
+		int retval;
+		FD_ZERO(&fdset);
+		FD_SET(fileno(stdin), &fdset);
+		tv.tv_sec = 0;
+		tv.tv_usec = 1;
+		retval = select(1, &fdset, NULL, NULL, &tv);
+		if (retval < 0) {
+			perror("select");
+		} else if (retval > 0) {
+			if (FD_ISSET(fileno(stdin), &fdset)) {
+				int cmd = read_commands(r);
+				if (cmd == LSP_KILL) {
+					lsp_packet_t kill_packet = build_kill_packet(r->id);
+					sendall(r, &kill_packet, NULL);
+					printf("%s: exiting...\n", r->id);
+					done = 1;
+				} else if (cmd < 0) {
+					watch_stdin = 0;
+				}
+			}
+		}
 	}
-	return changed;
+
+	free(readers);
 }
 
-void log_lsp(FILE *fp, lsp_packet_t *packet) {
-	int i;
-	fprintf(fp, "LSP\n");
-	fprintf(fp, "SOURCE: %s\n", packet->header.src_id);
-	fprintf(fp, "TIME: %ld\n", time(NULL));
-	fprintf(fp, " ID | COST\n");
-	fprintf(fp, "----------\n");
-	for (i = 0; i < packet->header.entries; ++i) {
-		lsp_entry_t entry = packet->data[i];
-		fprintf(fp, " %s  | %4d\n", entry.id, entry.cost);
-	}
-	fprintf(fp, "\n");
-	fflush(fp);
+/*
+ * io_uring event loop. Every neighbor socket has a multishot receive armed
+ * against a ring of provided buffers, floods are queued per neighbor and
+ * submitted as linked chains so packets on one socket stay in order, and the
+ * log is written through a stdio cookie that turns each flush into an
+ * asynchronous write. Each request carries a pointer whose first member is
+ * one of the EV_ types below.
+ */
+
+enum { EV_RECV, EV_SEND, EV_WRITE, EV_STDIN, EV_TIMER, EV_FEED, EV_QUERY, EV_SUBSCRIBER };
+
+typedef struct {
+	int refs;
+	size_t len;
+	lsp_packet_t packet;
+} tx_buf_t;
+
+struct uring_peer;
+
+typedef struct tx_req {
+	int type;
+	struct uring_peer *peer;
+	tx_buf_t *buf;
+	struct tx_req *next;
+} tx_req_t;
+
+typedef struct uring_peer {
+	int type;
+	int sock;
+	char id[MAX_ID_LEN];
+	lsp_reader_t reader;
+	tx_req_t *head;
+	tx_req_t *tail;
+	int inflight;
+} uring_peer_t;
+
+typedef struct {
+	int type;
+	int pooled;
+	size_t len;
+	char data[];
+} log_chunk_t;
+
+/* A poll armed on a feed subscriber */
+typedef struct {
+	int type;
+	struct feed_client *client;
+	int events;
+} sub_poll_t;
+
+typedef struct {
+	router_t *router;
+	uring_p ring;
+	uring_peer_t *peers;
+	unsigned int num_peers;
+	int log_fd;
+	off_t log_offset;
+	unsigned int pending;  // Sends and writes not yet completed
+	int stdin_type;
+	int timer_type;
+	int feed_type;
+	int query_type;
+	int query_busy;  // Lookups left over from the last query_poll()
+	pool_p tx_bufs;
+	pool_p tx_reqs;
+	pool_p log_chunks;
+	pool_p sub_polls;
+} uring_loop_t;
+
+static void uring_free_chunk(uring_loop_t *u, log_chunk_t *chunk) {
+	if (chunk->pooled) {
+		pool_put(u->log_chunks, chunk);
+	} else {
+		free(chunk);
+	}
+}
+
+static ssize_t uring_log_write(void *cookie, const char *buf, size_t size) {
+	uring_loop_t *u = cookie;
+	log_chunk_t *chunk;
+	if (size <= LOG_CHUNK_SIZE) {
+		chunk = pool_get(u->log_chunks);
+		chunk->pooled = 1;
+	} else {
+		chunk = malloc(sizeof(log_chunk_t) + size);
+		chunk->pooled = 0;
+	}
+	chunk->type = EV_WRITE;
+	chunk->len = size;
+	memcpy(chunk->data, buf, size);
+	if (uring_write(u->ring, u->log_fd, chunk->data, size, u->log_offset, chunk) < 0) {
+		uring_free_chunk(u, chunk);
+		errno = EIO;
+		return -1;
+	}
+	u->log_offset += size;
+	u->pending++;
+	return size;
 }
 
-void log_table(FILE *fp, vector_p table) {
+void uring_sendall(uring_loop_t *u, lsp_packet_t *packet, char *ignore_id) {
 	unsigned int i;
-	fprintf(fp, "==================================\n");
-	fprintf(fp, "ROUTING TABLE\n");
-	fprintf(fp, "TIME = %ld\n", time(NULL));
-	fprintf(fp, " ID | COST | OUT PORT | DEST PORT \n");
-	fprintf(fp, "----------------------------------\n");
-	for (i = 0; i < table->length; ++i) {
-		table_entry_t *entry = vector_get(table, i);
-		fprintf(fp, "  %s | %4d | %8d | %9d \n", entry->dest_id, entry->cost, entry->out_port, entry->dest_port);
-	}
-	fprintf(fp, "==================================\n\n");
-	fflush(fp);
+	tx_buf_t *buf = pool_get(u->tx_bufs);
+	buf->refs = 0;
+	buf->len = packet->header.length;
+	memcpy(&buf->packet, packet, buf->len);
+	for (i = 0; i < u->num_peers; ++i) {
+		uring_peer_t *peer = &u->peers[i];
+		if (!link_floods(u->router, i, packet)) {
+			continue;
+		}
+		if (ignore_id == NULL || strncmp(peer->id, ignore_id, MAX_ID_LEN) != 0) {
+			tx_req_t *req = pool_get(u->tx_reqs);
+			req->type = EV_SEND;
+			req->peer = peer;
+			req->buf = buf;
+			req->next = NULL;
+			if (peer->tail == NULL) {
+				peer->head = req;
+			} else {
+				peer->tail->next = req;
+			}
+			peer->tail = req;
+			buf->refs++;
+		}
+	}
+	if (buf->refs == 0) {
+		pool_put(u->tx_bufs, buf);
+	}
 }
 
-void sendall(vector_p neighbors, hashmap_p socks, lsp_packet_t *packet, char *ignore_id) {
+void uring_release(uring_loop_t *u, tx_req_t *req) {
+	if (--req->buf->refs == 0) {
+		pool_put(u->tx_bufs, req->buf);
+	}
+	pool_put(u->tx_reqs, req);
+}
+
+/* Submits queued packets for every neighbor that has nothing in flight */
+void uring_kick(uring_loop_t *u) {
 	unsigned int i;
-	for (i = 0; i < neighbors->length; ++i) {
-		table_entry_t *entry = vector_get(neighbors, i);
-		if (ignore_id == NULL || strncmp(entry->dest_id, ignore_id, MAX_ID_LEN) != 0) {
-			int *sock = hashmap_get(socks, entry->dest_id);
-			if (send(*sock, packet, sizeof(lsp_packet_t), 0) < 0) {
-				perror("send");
+	for (i = 0; i < u->num_peers; ++i) {
+		uring_peer_t *peer = &u->peers[i];
+		while (peer->inflight == 0 && peer->head != NULL) {
+			tx_req_t *req;
+			int len = 0;
+			int n = 0;
+
+			// Room for the whole chain, so it goes to the kernel in one piece
+			for (req = peer->head; req != NULL && len < URING_MAX_CHAIN; req = req->next) {
+				len++;
+			}
+			if (uring_reserve(u->ring, len) < 0) {
+				fprintf(stderr, "%s: send queue full\n", u->router->id);
+				break;
+			}
+			while (n < len) {
+				req = peer->head;
+				peer->head = req->next;
+				if (peer->head == NULL) {
+					peer->tail = NULL;
+				}
+				if (uring_send(u->ring, peer->sock, &req->buf->packet, req->buf->len, 1, req) < 0) {
+					fprintf(stderr, "%s: send queue full\n", u->router->id);
+					uring_release(u, req);
+					len--;
+					continue;
+				}
+				u->pending++;
+				n++;
 			}
+			if (n == 0) {
+				break;
+			}
+			uring_end_chain(u->ring);
+			peer->inflight = n;
+		}
+	}
+}
+
+/* Arms the polls the feed wants on its subscribers, so backlogs are sent as
+   soon as there is room and subscribers that hang up are dropped */
+void uring_watch_feed(uring_loop_t *u) {
+	struct feed_client *client;
+	int sock;
+	int events;
+	while ((client = feed_wait(u->router->feed, &sock, &events)) != NULL) {
+		sub_poll_t *poll = pool_get(u->sub_polls);
+		poll->type = EV_SUBSCRIBER;
+		poll->client = client;
+		poll->events = events;
+		if (uring_poll_events(u->ring, sock, events, poll) < 0) {
+			// Try again next time around
+			pool_put(u->sub_polls, poll);
+			feed_ready(u->router->feed, client, events, 0);
+			break;
+		}
+	}
+}
+
+/* Hands each complete packet in data to the router. Returns 1 on a kill. */
+int uring_recv_data(uring_loop_t *u, uring_peer_t *peer, char *data, size_t len) {
+	lsp_packet_t *packet;
+	while ((packet = lsp_read(&peer->reader, &data, &len)) != NULL) {
+		char ignore_id[MAX_ID_LEN];
+		int action;
+		if (u->router->trace != NULL) {
+			trace_lsp(u->router->trace, peer - u->peers, packet);
+		}
+		action = handle_lsp(u->router, packet, ignore_id, time(NULL));
+		if (action & LSP_FORWARD) {
+			uring_sendall(u, packet, ignore_id);
+		}
+		if (action & LSP_KILL) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Handles one completion. Once done is set only sends and writes are still
+   tracked. Returns 1 if the router should shut down. */
+int uring_handle_event(uring_loop_t *u, uring_event_t *ev, int done) {
+	router_t *r = u->router;
+	int type = *(int *) ev->data;
+	int kill = 0;
+
+	if (type == EV_RECV) {
+		uring_peer_t *peer = ev->data;
+		if (ev->bid >= 0) {
+			if (ev->res > 0 && !done) {
+				kill = uring_recv_data(u, peer, uring_buffer(u->ring, ev->bid), ev->res);
+			}
+			uring_recycle_buffer(u->ring, ev->bid);
+		}
+		if (!ev->more && !done && !kill) {
+			if (ev->res > 0 || ev->res == -ENOBUFS) {
+				uring_recv_multishot(u->ring, peer->sock, peer);
+			} else if (ev->res < 0) {
+				fprintf(stderr, "recv: %s\n", strerror(-ev->res));
+			}
+		}
+
+	} else if (type == EV_SEND) {
+		tx_req_t *req = ev->data;
+		if (ev->res < 0 && ev->res != -ECANCELED) {
+			fprintf(stderr, "send: %s\n", strerror(-ev->res));
 		}
+		req->peer->inflight--;
+		uring_release(u, req);
+		u->pending--;
+
+	} else if (type == EV_WRITE) {
+		if (ev->res < 0) {
+			fprintf(stderr, "write: %s\n", strerror(-ev->res));
+		}
+		uring_free_chunk(u, ev->data);
+		u->pending--;
+
+	} else if (type == EV_STDIN && !done) {
+		int cmd = read_commands(r);
+		if (cmd == LSP_KILL) {
+			lsp_packet_t kill_packet = build_kill_packet(r->id);
+			uring_sendall(u, &kill_packet, NULL);
+			printf("%s: exiting...\n", r->id);
+			kill = 1;
+		} else if (cmd == 0) {
+			uring_poll(u->ring, fileno(stdin), &u->stdin_type);
+		}
+
+	} else if (type == EV_TIMER && !done) {
+		age_lsdb(r, time(NULL));
+		uring_timeout(u->ring, 1000, &u->timer_type);
+
+	} else if (type == EV_FEED && !done) {
+		feed_accept(r->feed, r->routing_table);
+		uring_poll(u->ring, r->feed->sock, &u->feed_type);
+
+	} else if (type == EV_QUERY && !done) {
+		u->query_busy = query_poll(r->query);
+		uring_poll(u->ring, query_fd(r->query), &u->query_type);
+
+	} else if (type == EV_SUBSCRIBER) {
+		sub_poll_t *poll = ev->data;
+		feed_ready(r->feed, poll->client, poll->events, ev->res < 0 ? POLLERR : ev->res);
+		pool_put(u->sub_polls, poll);
 	}
+
+	return kill;
+}
+
+/* Runs the router on io_uring. Returns -1 without touching any state if
+   io_uring is unavailable, so the caller can fall back to select. */
+int run_uring_loop(router_t *r) {
+	uring_loop_t u;
+	uring_event_t ev;
+	lsp_packet_t *packet;
+	cookie_io_functions_t log_funcs = { NULL, uring_log_write, NULL, NULL };
+	FILE *plain_logfp = r->logfp;
+	unsigned int i;
+	int done = 0;
+
+	memset(&u, '\0', sizeof(u));
+	if ((u.ring = create_uring(URING_ENTRIES)) == NULL) {
+		return -1;
+	}
+	if (uring_provide_buffers(u.ring, URING_BUFFERS, sizeof(lsp_packet_t)) < 0 ||
+			!uring_probe_recv_multishot(u.ring)) {
+		destroy_uring(u.ring);
+		return -1;
+	}
+
+	u.router = r;
+	u.tx_bufs = create_pool(sizeof(tx_buf_t), POOL_SLAB);
+	u.tx_reqs = create_pool(sizeof(tx_req_t), POOL_SLAB);
+	u.log_chunks = create_pool(sizeof(log_chunk_t) + LOG_CHUNK_SIZE, POOL_SLAB);
+	u.sub_polls = create_pool(sizeof(sub_poll_t), POOL_SLAB);
+	u.stdin_type = EV_STDIN;
+	u.timer_type = EV_TIMER;
+	u.feed_type = EV_FEED;
+	u.query_type = EV_QUERY;
+	u.num_peers = r->neighbors->length;
+	u.peers = calloc(u.num_peers, sizeof(uring_peer_t));
+	for (i = 0; i < u.num_peers; ++i) {
+		table_entry_t *entry = vector_get(r->neighbors, i);
+		uring_peer_t *peer = &u.peers[i];
+		peer->type = EV_RECV;
+		peer->sock = *(int *) hashmap_get(r->socks, entry->dest_id);
+		strncpy(peer->id, entry->dest_id, MAX_ID_LEN);
+
+		// io_uring waits for the socket itself, so it should block
+		fcntl(peer->sock, F_SETFL, fcntl(peer->sock, F_GETFL) & ~O_NONBLOCK);
+		uring_recv_multishot(u.ring, peer->sock, peer);
+	}
+
+	// Route the log through the ring from where the plain file left off
+	fflush(plain_logfp);
+	u.log_fd = fileno(plain_logfp);
+	u.log_offset = ftello(plain_logfp);
+	r->logfp = fopencookie(&u, "w", log_funcs);
+	setvbuf(r->logfp, NULL, _IOFBF, LOG_BUF_SIZE);
+
+	uring_poll(u.ring, fileno(stdin), &u.stdin_type);
+	uring_timeout(u.ring, 1000, &u.timer_type);
+	if (r->feed != NULL) {
+		uring_poll(u.ring, r->feed->sock, &u.feed_type);
+	}
+	if (r->query != NULL) {
+		uring_poll(u.ring, query_fd(r->query), &u.query_type);
+	}
+
+	printf("%s: using io_uring\n", r->id);
+
+	// Keep going after a kill until the kill packet and the log are written
+	while (!done || u.pending > 0) {
+		// Don't sleep while queries are waiting to be answered
+		if (uring_submit(u.ring, u.query_busy ? 0 : 1) < 0) {
+			perror("io_uring_enter");
+			break;
+		}
+		while (uring_next(u.ring, &ev)) {
+			if (uring_handle_event(&u, &ev, done)) {
+				done = 1;
+				fflush(r->logfp);
+			}
+		}
+		while (!done && (packet = next_lsp(r)) != NULL) {
+			uring_sendall(&u, packet, NULL);
+		}
+		if (r->feed != NULL) {
+			feed_flush(r->feed);
+			uring_watch_feed(&u);
+		}
+		if (u.query_busy && !done) {
+			u.query_busy = query_poll(r->query);
+		}
+		uring_kick(&u);
+	}
+
+	fclose(r->logfp);
+	r->logfp = plain_logfp;
+	fseeko(plain_logfp, u.log_offset, SEEK_SET);
+
+	for (i = 0; i < u.num_peers; ++i) {
+		while (u.peers[i].head != NULL) {
+			tx_req_t *req = u.peers[i].head;
+			u.peers[i].head = req->next;
+			uring_release(&u, req);
+		}
+	}
+	free(u.peers);
+	destroy_pool(u.tx_bufs);
+	destroy_pool(u.tx_reqs);
+	destroy_pool(u.log_chunks);
+	destroy_pool(u.sub_polls);
+	destroy_uring(u.ring);
+	return 0;
 }
 
 int main(int argc, char *argv[]) {
 
-	char *router_id;
 	char *log_filename;
 	char *init_filename;
-	FILE *logfp;
+	char *feed_path = NULL;
+	char *query_path = NULL;
+	char *trace_path = NULL;
 	FILE *initfp;
-	vector_p neighbors;
-	vector_p routing_table;
-	hashmap_p recvd_packets;
-	hashmap_p socks;  // Maps router IDs to socket FDs
-	int sequence_num = 0;
-	time_t old_time;
-	time_t new_time;
-	unsigned int i;
+	router_t router;
+	int use_uring = 0;
+	int dense_spf = 0;
+	long allocs;
+	int opt;
+
+	// Check options
+	while ((opt = getopt(argc, argv, "umf:q:t:")) != -1) {
+		switch (opt) {
+		case 'u':
+			use_uring = 1;
+			break;
+		case 'm':
+			dense_spf = 1;
+			break;
+		case 'f':
+			feed_path = optarg;
+			break;
+		case 'q':
+			query_path = optarg;
+			break;
+		case 't':
+			trace_path = optarg;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s %s\n", argv[0], USAGE);
+			return EXIT_FAILURE;
+		}
+	}
 
 	// Check arguments
-	if (argc < ARG_MIN) {
+	if (argc - optind < ARG_MIN) {
 		fprintf(stderr, "Usage: %s %s\n", argv[0], USAGE);
 		return EXIT_FAILURE;
 	}
 
 	// Extract arguments
-	router_id = argv[1];
-	log_filename = argv[2];
-	init_filename = argv[3];
+	memset(&router, '\0', sizeof(router));
+	router.id = argv[optind];
+	if (dense_spf) {
+		router.dense = create_spf_dense();
+	}
+	log_filename = argv[optind + 1];
+	init_filename = argv[optind + 2];
 
 	// Open initialization file
 	if ((initfp = fopen(init_filename, "r")) == NULL) {
@@ -327,133 +757,84 @@ int main(int argc, char *argv[]) {
 	}
 
 	// Open log file
-	if ((logfp = fopen(log_filename, "w+")) == NULL) {
+	if ((router.logfp = fopen(log_filename, "w+")) == NULL) {
 		fprintf(stderr, "Error opening file: %s\n", log_filename);
 		perror("fopen");
 		return EXIT_FAILURE;
 	}
 
 	// Initialize data structures
-	neighbors = create_vector();
-	routing_table = create_vector();
-	recvd_packets = create_hashmap();
-	socks = create_hashmap();
-
-	init_router(initfp, router_id, neighbors, routing_table);
-	build_socks_map(socks, neighbors);
-
-	// Create LSP
-	lsp_packet_t packet;
-	int entries = 0;
-
-	for (i = 0; i < neighbors->length; ++i) {
-		table_entry_t *entry = vector_get(neighbors, i);
+	router.neighbors = create_vector();
+	router.link_areas = create_vector();
+	router.members = create_vector();
+	create_tables(&router);
+	router.socks = create_hashmap();
 
-		lsp_entry_t lsp_entry;
-		strncpy(lsp_entry.id, entry->dest_id, MAX_ID_LEN);
-		lsp_entry.cost = entry->cost;
+	init_router(initfp, router.id, router.neighbors, router.routing_table, router.link_areas, router.members);
 
-		packet.data[i] = lsp_entry;
-
-		++entries;
+	// Open route change feed
+	if (feed_path != NULL && (router.feed = create_feed(feed_path)) == NULL) {
+		fprintf(stderr, "Error opening feed socket: %s\n", feed_path);
+		return EXIT_FAILURE;
 	}
 
-	int len = sizeof(lsp_header_t) + (sizeof(lsp_entry_t) * entries);
-	packet.header = build_header(sequence_num, router_id, 0, len, entries, TTL);
-	++sequence_num;
-
-	log_table(logfp, routing_table);
+	// Open route query socket
+	if (query_path != NULL) {
+		if ((router.query = create_query(query_path)) == NULL) {
+			fprintf(stderr, "Error opening query socket: %s\n", query_path);
+			return EXIT_FAILURE;
+		}
+		query_update(router.query, router.routing_table);
+	}
 
-	old_time = new_time = time(NULL);
+	// Start capturing received LSPs
+	if (trace_path != NULL &&
+		(router.trace = create_trace(trace_path, router.id, router.neighbors, router.link_areas, router.members)) == NULL) {
+		fprintf(stderr, "Error opening trace file: %s\n", trace_path);
+		return EXIT_FAILURE;
+	}
 
-	int done = 0;
+	build_socks_map(router.socks, router.neighbors);
 
-	while (!done) {
+	// Create LSDBs and our LSP in each area
+	create_areas(&router);
 
-		new_time = time(NULL);
+	log_table(router.logfp, router.routing_table);
 
-		if (new_time >= old_time + 5) {
-			old_time = new_time;
-			printf("%s: sending...\n", router_id);
-			sequence_num++;
-			packet.header.seq_num = sequence_num;
-			sendall(neighbors, socks, &packet, NULL);
+	allocs = alloc_count();
+	if (!use_uring || run_uring_loop(&router) < 0) {
+		if (use_uring) {
+			fprintf(stderr, "%s: io_uring unavailable, using select\n", router.id);
 		}
+		run_select_loop(&router);
+	}
 
-		for (i = 0; i < neighbors->length; ++i) {
-			table_entry_t *entry = vector_get(neighbors, i);
-			int *sock = hashmap_get(socks, entry->dest_id);
-			lsp_packet_t new_packet;
-			memset(&new_packet, '\0', sizeof(new_packet));
-			int retval = recv(*sock, &new_packet, sizeof(new_packet), O_NONBLOCK);
-			if (retval < 0) {
-				if (errno != EAGAIN && errno != EWOULDBLOCK) {
-					perror("recv");
-				}
-			} else if (retval > 0) {
-				int *entry = hashmap_get(recvd_packets, new_packet.header.src_id);
-				if (entry == NULL || *entry < new_packet.header.seq_num) {
-
-					if (new_packet.header.flags & FLAG_KILL) {  // Kill packet
-						fprintf(logfp, "kill packet received\n");
-						log_lsp(logfp, &new_packet);
-						char from[MAX_ID_LEN];
-						strncpy(from, new_packet.header.src_id, MAX_ID_LEN);
-						strncpy(new_packet.header.src_id, router_id, MAX_ID_LEN);
-						new_packet.header.ttl--;
-						if (new_packet.header.ttl > 0) {
-							sendall(neighbors, socks, &new_packet, from);
-						}
-						done = 1;
-						break;
-
-					} else {  // Regular packet
-						hashmap_put(recvd_packets, new_packet.header.src_id, &(new_packet.header.seq_num), sizeof(int));
-						log_lsp(logfp, &new_packet);
-						if (update_routing_table(routing_table, &new_packet, router_id)) {
-							log_table(logfp, routing_table);
-						}
-						new_packet.header.ttl--;
-						if (new_packet.header.ttl > 0) {
-							sendall(neighbors, socks, &new_packet, new_packet.header.src_id);
-						}
-					}
-				}
-			}
-		}
+	print_stats(&router, allocs);
 
-		fd_set fdset;
-		struct timeval tv;
-		int retval;
-		FD_ZERO(&fdset);
-		FD_SET(fileno(stdin), &fdset);
-		tv.tv_sec = 0;
-		tv.tv_usec = 1;
-		retval = select(1, &fdset, NULL, NULL, &tv);
-		if (retval < 0) {
-			perror("select");
-		} else if (retval > 0) {
-			if (FD_ISSET(fileno(stdin), &fdset)) {
-				char cmd[32];
-				if (read(fileno(stdin), cmd, sizeof(cmd)) < 0) {
-					perror("read");
-				}
-				if (strncmp(cmd, "exit", 4) == 0) {
-					lsp_packet_t kill_packet;
-					kill_packet.header = build_header(INT_MAX, router_id, FLAG_KILL, 0, 0, TTL);
-					sendall(neighbors, socks, &kill_packet, NULL);
-					printf("%s: exiting...\n", router_id);
-					done = 1;
-				}
-			}
-		}
+	// Finish the trace with the table a replay should arrive at, aged to
+	// the time it is recorded at as the replay will age its own
+	if (router.trace != NULL) {
+		age_lsdb(&router, time(NULL));
+		trace_table(router.trace, router.routing_table);
+		destroy_trace(router.trace);
 	}
 
 	// Destroy data structures
-	destroy_vector(neighbors);
-	destroy_vector(routing_table);
-	destroy_hashmap(recvd_packets);
-	destroy_hashmap(socks);
+	destroy_areas(&router);
+	destroy_vector(router.neighbors);
+	destroy_vector(router.link_areas);
+	destroy_vector(router.members);
+	destroy_tables(&router);
+	if (router.dense != NULL) {
+		destroy_spf_dense(router.dense);
+	}
+	if (router.feed != NULL) {
+		destroy_feed(router.feed);
+	}
+	if (router.query != NULL) {
+		destroy_query(router.query);
+	}
+	destroy_hashmap(router.socks);
 
 	// Close initialization file
 	if (fclose(initfp) != 0) {
@@ -463,7 +844,7 @@ int main(int argc, char *argv[]) {
 	}
 
 	// Close log file
-	if (fclose(logfp) != 0) {
+	if (fclose(router.logfp) != 0) {
 		fprintf(stderr, "Error closing file %s\n", log_filename);
 		perror("fclose");
 		return EXIT_FAILURE;
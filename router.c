@@ -0,0 +1,856 @@
+#include "router.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+static double router_clock() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Charges the time since *start to stage and starts the next stage */
+static void stage_done(router_t *r, double *stage, double *start) {
+	double now;
+	if (r->timed) {
+		now = router_clock();
+		*stage += now - *start;
+		*start = now;
+	}
+}
+
+void init_router(FILE* fp, char *router_id, vector_p neighbors, vector_p table, vector_p areas, vector_p members) {
+
+	char *line = NULL;  // Current line
+	size_t len = 0;     // Buffer length
+	ssize_t read;       // Bytes read
+	char *str;          // Current string
+	int mine;           // Line is one of our links
+
+	// Read line in file
+	while ((read = getline(&line, &len, fp)) != -1) {
+
+		// Parse for router ID
+		str = strtok(line, " ,<>\n");
+		mine = str != NULL && strncmp(str, router_id, MAX_ID_LEN) == 0;
+
+		// Only parse line fully if direct neighbor of router ID, or if
+		// every router's areas are wanted
+		if (mine || (str != NULL && members != NULL)) {
+			char *port1 = strtok(NULL, " ,<>\n");
+			char *node  = strtok(NULL, " ,<>\n");
+			char *port2 = strtok(NULL, " ,<>\n");
+			char *cost  = strtok(NULL, " ,<>\n");
+			char *area  = strtok(NULL, " ,<>\n");  // Optional
+
+			if (members != NULL && port1 != NULL && node != NULL && port2 != NULL && cost != NULL) {
+				area_member_t member;
+				memset(&member, '\0', sizeof(member));
+				snprintf(member.id, MAX_ID_LEN, "%s", str);
+				member.area = area != NULL ? atoi(area) : BACKBONE_AREA;
+				vector_add(members, &member, sizeof(member));
+			}
+			if (mine && port1 != NULL && node != NULL && port2 != NULL && cost != NULL) {
+				table_entry_t entry;
+				strncpy(entry.dest_id, node, MAX_ID_LEN);
+				entry.out_port = atoi(port1);
+				entry.dest_port = atoi(port2);
+				entry.cost = atoi(cost);
+				vector_add(neighbors, &entry, sizeof(entry));
+				vector_add(table, &entry, sizeof(entry));
+				if (areas != NULL) {
+					int area_id = area != NULL ? atoi(area) : BACKBONE_AREA;
+					vector_add(areas, &area_id, sizeof(area_id));
+				}
+			}
+		}
+	}
+
+	// Free memory
+	free(line);
+}
+
+lsp_header_t build_header(int seq_num, char *src_id, int flags, int length, int entries, int ttl, int fragment, int area) {
+	lsp_header_t header;
+	memset(&header, '\0', sizeof(header));  // No stray stack bytes on the wire
+	header.seq_num = seq_num;
+	snprintf(header.src_id, MAX_ID_LEN, "%s", src_id);
+	header.flags = flags;
+	header.length = length;
+	header.entries = entries;
+	header.ttl = ttl;
+	header.fragment = fragment;
+	header.area = area;
+	return header;
+}
+
+/* Returns 1 if table contains id, 0 otherwise */
+int table_contains(vector_p table, char *id) {
+	unsigned int i;
+	for (i = 0; i < table->length; ++i) {
+		table_entry_t *entry = vector_get(table, i);
+		if (strncmp(id, entry->dest_id, MAX_ID_LEN) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+table_entry_t* table_get_by_id(vector_p table, char *id) {
+	unsigned int i;
+	for (i = 0; i < table->length; ++i) {
+		table_entry_t *entry = vector_get(table, i);
+		if (strncmp(entry->dest_id, id, MAX_ID_LEN) == 0) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+void create_tables(router_t *r) {
+	r->entries = create_pool(sizeof(table_entry_t), ENTRIES_PER_SLAB);
+	r->routing_table = create_pool_vector(r->entries);
+	r->spare_table = create_pool_vector(r->entries);
+	r->spf = create_spf();
+}
+
+void destroy_tables(router_t *r) {
+	destroy_vector(r->routing_table);
+	destroy_vector(r->spare_table);
+	destroy_pool(r->entries);
+	destroy_spf(r->spf);
+}
+
+router_area_t* find_area(router_t *r, int id) {
+	int a;
+	for (a = 0; a < r->num_areas; ++a) {
+		if (r->areas[a].id == id) {
+			return &r->areas[a];
+		}
+	}
+	return NULL;
+}
+
+/* Gets the area ID of our link to neighbor i */
+static int link_area_id(router_t *r, unsigned int i) {
+	if (r->link_areas == NULL || i >= r->link_areas->length) {
+		return BACKBONE_AREA;
+	}
+	return *(int *) vector_get(r->link_areas, i);
+}
+
+static router_area_t* add_area(router_t *r, int id) {
+	router_area_t *area;
+	r->areas = realloc(r->areas, (r->num_areas + 1) * sizeof(router_area_t));
+	area = &r->areas[r->num_areas++];
+	memset(area, '\0', sizeof(router_area_t));
+	area->id = id;
+	area->neighbors = create_vector();
+	area->lsdb = create_lsdb();
+	area->routes = create_pool_vector(r->entries);
+	area->stale = 1;
+	return area;
+}
+
+/* Rewrites fragment f of our LSP in an area from our links in it and marks
+   it to be sent. */
+static void fill_fragment(router_area_t *area, int f) {
+	lsp_packet_t *packet = &area->fragments[f].packet;
+	unsigned int i;
+	int entries = 0;
+
+	for (i = f * MAX_LSP_ENTRIES; i < area->neighbors->length && entries < MAX_LSP_ENTRIES; ++i) {
+		table_entry_t *entry = vector_get(area->neighbors, i);
+		strncpy(packet->data[entries].id, entry->dest_id, MAX_ID_LEN);
+		packet->data[entries].cost = entry->cost;
+		++entries;
+	}
+
+	packet->header.entries = entries;
+	packet->header.length = LSP_LENGTH(entries);
+	area->fragments[f].dirty = 1;
+}
+
+/* Splits our links in an area into fragments of up to MAX_LSP_ENTRIES each.
+   Link i of the area always lives in fragment i / MAX_LSP_ENTRIES, so a
+   change to one link only touches one fragment. A border router's summaries
+   start out with a fragment of their own after the links, and get more as
+   they need them. */
+static void build_lsp(router_t *r, router_area_t *area, time_t now) {
+	int summaries = r->num_areas > 1;
+	int max_links = MAX_LSP_FRAGMENTS - summaries;
+	int i;
+
+	area->link_fragments = (area->neighbors->length + MAX_LSP_ENTRIES - 1) / MAX_LSP_ENTRIES;
+	if (area->link_fragments == 0) {
+		area->link_fragments = 1;
+	} else if (area->link_fragments > max_links) {
+		fprintf(stderr, "%s: only advertising the first %d neighbors in area %d\n", r->id, max_links * MAX_LSP_ENTRIES, area->id);
+		area->link_fragments = max_links;
+	}
+
+	area->num_fragments = area->link_fragments + summaries;
+	area->fragments = calloc(area->num_fragments, sizeof(lsp_fragment_t));
+	for (i = 0; i < area->num_fragments; ++i) {
+		area->fragments[i].packet.header = build_header(0, r->id, 0, LSP_LENGTH(0), 0, TTL, i, area->id);
+		if (i < area->link_fragments) {
+			fill_fragment(area, i);
+		}
+		area->fragments[i].last_sent = now;
+		area->fragments[i].dirty = 0;
+	}
+}
+
+/* Orders members by router ID, then area */
+static int compare_member(const void *a, const void *b) {
+	const area_member_t *x = a;
+	const area_member_t *y = b;
+	int c = strncmp(x->id, y->id, MAX_ID_LEN);
+	if (c != 0) {
+		return c;
+	}
+	return x->area < y->area ? -1 : x->area > y->area;
+}
+
+/* Orders remote members by area, then router ID */
+static int compare_remote(const void *a, const void *b) {
+	const remote_member_t *x = a;
+	const remote_member_t *y = b;
+	if (x->area != y->area) {
+		return x->area < y->area ? -1 : 1;
+	}
+	return strncmp(x->id, y->id, MAX_ID_LEN);
+}
+
+/* Picks out of members the routers we share no area with, each area of
+   theirs once, numbering each router. Routers in one of our areas are
+   reached within it, just as route_usable() prefers routes within an area. */
+static void find_remote(router_t *r) {
+	unsigned int len = r->members->length;
+	area_member_t *sorted = malloc((len + 1) * sizeof(area_member_t));
+	unsigned int routers = 0;
+	unsigned int n = 0;
+	unsigned int i;
+	unsigned int j;
+	unsigned int k;
+
+	for (i = 0; i < len; ++i) {
+		memcpy(&sorted[i], vector_get(r->members, i), sizeof(area_member_t));
+	}
+	qsort(sorted, len, sizeof(area_member_t), compare_member);
+
+	r->remote = malloc((len + 1) * sizeof(remote_member_t));
+	for (i = 0; i < len; i = j) {
+		int ours = 0;
+		for (j = i; j < len && strncmp(sorted[j].id, sorted[i].id, MAX_ID_LEN) == 0; ++j) {
+			ours |= find_area(r, sorted[j].area) != NULL;
+		}
+		if (ours) {
+			continue;
+		}
+		for (k = i; k < j; ++k) {
+			if (k == i || sorted[k].area != sorted[k - 1].area) {
+				memcpy(r->remote[n].id, sorted[k].id, MAX_ID_LEN);
+				r->remote[n].area = sorted[k].area;
+				r->remote[n].router = routers;
+				++n;
+			}
+		}
+		++routers;
+	}
+	free(sorted);
+	qsort(r->remote, n, sizeof(remote_member_t), compare_remote);
+	r->num_remote = n;
+	r->remote_pass = calloc(routers + 1, sizeof(unsigned int));
+	r->pass = 0;
+	r->remote_routes = malloc((routers + 1) * sizeof(table_entry_t));
+}
+
+void create_areas(router_t *r) {
+	time_t now = time(NULL);
+	unsigned int i;
+	int a;
+
+	for (i = 0; i < r->neighbors->length; ++i) {
+		router_area_t *area = find_area(r, link_area_id(r, i));
+		if (area == NULL) {
+			area = add_area(r, link_area_id(r, i));
+		}
+		area->links = realloc(area->links, (area->neighbors->length + 1) * sizeof(unsigned int));
+		area->links[area->neighbors->length] = i;
+		vector_add(area->neighbors, vector_get(r->neighbors, i), sizeof(table_entry_t));
+	}
+	if (r->num_areas == 0) {
+		add_area(r, BACKBONE_AREA);
+	}
+	for (a = 0; a < r->num_areas; ++a) {
+		build_lsp(r, &r->areas[a], now);
+	}
+	if (r->members != NULL) {
+		find_remote(r);
+	}
+}
+
+void destroy_areas(router_t *r) {
+	int a;
+	for (a = 0; a < r->num_areas; ++a) {
+		router_area_t *area = &r->areas[a];
+		destroy_vector(area->neighbors);
+		free(area->links);
+		destroy_lsdb(area->lsdb);
+		free(area->fragments);
+		destroy_vector(area->routes);
+	}
+	free(r->areas);
+	free(r->merge);
+	free(r->summaries);
+	free(r->remote);
+	free(r->remote_pass);
+	free(r->remote_routes);
+	r->areas = NULL;
+	r->num_areas = 0;
+	r->remote = NULL;
+	r->remote_pass = NULL;
+	r->remote_routes = NULL;
+	r->num_remote = 0;
+}
+
+/* Kill packets go out over every link, anything else only over links that
+   are up and in the area it is flooded in */
+int link_floods(router_t *r, unsigned int i, lsp_packet_t *packet) {
+	table_entry_t *entry = vector_get(r->neighbors, i);
+	if (packet->header.flags & FLAG_KILL) {
+		return 1;
+	}
+	return LINK_UP(entry) && link_area_id(r, i) == packet->header.area;
+}
+
+/* Computes the routes over one area into table */
+static void compute_routes(router_t *r, router_area_t *area, vector_p table) {
+	if (r->dense != NULL) {
+		spf_dense_compute(r->dense, area->lsdb, r->id, area->neighbors, table);
+	} else {
+		spf_compute(r->spf, area->lsdb, r->id, area->neighbors, table);
+	}
+	r->recomputes++;
+}
+
+/* Returns the area a summary entry stands for, or -1 if id is a router */
+static int summary_area(const char *id) {
+	return id[0] == AREA_PREFIX ? atoi(id + 1) : -1;
+}
+
+/* Returns 1 if a route found in area belongs in our table. We reach the
+   routers of our own areas directly, and a border router on the backbone
+   only takes summaries from the backbone, so a summary never finds its way
+   back into the area it came from. */
+static int route_usable(router_t *r, router_area_t *area, table_entry_t *entry) {
+	int id = summary_area(entry->dest_id);
+	if (id < 0) {
+		return 1;
+	} else if (find_area(r, id) != NULL) {
+		return 0;
+	}
+	return area->id == BACKBONE_AREA || find_area(r, BACKBONE_AREA) == NULL;
+}
+
+/* Orders routes by destination, then cost, then destination port */
+static int compare_route_id(const void *a, const void *b) {
+	const table_entry_t *x = *(table_entry_t * const *) a;
+	const table_entry_t *y = *(table_entry_t * const *) b;
+	int c = strncmp(x->dest_id, y->dest_id, MAX_ID_LEN);
+	if (c != 0) {
+		return c;
+	} else if (x->cost != y->cost) {
+		return x->cost < y->cost ? -1 : 1;
+	}
+	return x->dest_port < y->dest_port ? -1 : x->dest_port > y->dest_port;
+}
+
+/* Orders routes by cost, then destination */
+static int compare_route_cost(const void *a, const void *b) {
+	const table_entry_t *x = *(table_entry_t * const *) a;
+	const table_entry_t *y = *(table_entry_t * const *) b;
+	if (x->cost != y->cost) {
+		return x->cost < y->cost ? -1 : 1;
+	}
+	return strncmp(x->dest_id, y->dest_id, MAX_ID_LEN);
+}
+
+/* Fills table with the cheapest route to every destination in any of our
+   areas, in order of increasing cost */
+static void merge_routes(router_t *r, vector_p table) {
+	unsigned int n = 0;
+	unsigned int kept = 0;
+	unsigned int i;
+	int a;
+
+	for (a = 0; a < r->num_areas; ++a) {
+		n += r->areas[a].routes->length;
+	}
+	if (n > r->merge_cap) {
+		r->merge_cap = n;
+		r->merge = realloc(r->merge, n * sizeof(table_entry_t *));
+	}
+
+	n = 0;
+	for (a = 0; a < r->num_areas; ++a) {
+		router_area_t *area = &r->areas[a];
+		for (i = 0; i < area->routes->length; ++i) {
+			table_entry_t *entry = vector_get(area->routes, i);
+			if (route_usable(r, area, entry)) {
+				r->merge[n++] = entry;
+			}
+		}
+	}
+
+	qsort(r->merge, n, sizeof(table_entry_t *), compare_route_id);
+	for (i = 0; i < n; ++i) {
+		if (kept == 0 || strncmp(r->merge[i]->dest_id, r->merge[kept - 1]->dest_id, MAX_ID_LEN) != 0) {
+			r->merge[kept++] = r->merge[i];
+		}
+	}
+	qsort(r->merge, kept, sizeof(table_entry_t *), compare_route_cost);
+	for (i = 0; i < kept; ++i) {
+		vector_add(table, r->merge[i], sizeof(table_entry_t));
+	}
+}
+
+/* Orders routes to summaries by cost, then area ID */
+static int compare_summary_route(const void *a, const void *b) {
+	const table_entry_t *x = *(table_entry_t * const *) a;
+	const table_entry_t *y = *(table_entry_t * const *) b;
+	int ax;
+	int ay;
+	if (x->cost != y->cost) {
+		return x->cost < y->cost ? -1 : 1;
+	}
+	ax = summary_area(x->dest_id);
+	ay = summary_area(y->dest_id);
+	return ax < ay ? -1 : ax > ay;
+}
+
+/* Returns the first remote member in area, or num_remote if there is none */
+static unsigned int find_remote_area(router_t *r, int area) {
+	unsigned int lo = 0;
+	unsigned int hi = r->num_remote;
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+		if (r->remote[mid].area < area) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/* Adds to table, which is in order of increasing cost, a route to every
+   router we share no area with through the cheapest summary of its areas.
+   Going through the summaries from the cheapest, a router gets its route
+   from the first of its areas found. The routes are then merged in from the
+   back after any route of the same cost, so the table stays in order. */
+static void add_remote_routes(router_t *r, vector_p table) {
+	unsigned int m = table->length;
+	unsigned int n = 0;
+	unsigned int k = 0;
+	unsigned int i;
+	unsigned int j;
+	int from;
+	int to;
+	int w;
+
+	if (r->num_remote == 0) {
+		return;
+	}
+	if (m > r->merge_cap) {
+		r->merge_cap = m;
+		r->merge = realloc(r->merge, m * sizeof(table_entry_t *));
+	}
+	for (i = 0; i < m; ++i) {
+		table_entry_t *entry = vector_get(table, i);
+		if (summary_area(entry->dest_id) >= 0) {
+			r->merge[n++] = entry;
+		}
+	}
+	qsort(r->merge, n, sizeof(table_entry_t *), compare_summary_route);
+
+	r->pass++;
+	for (i = 0; i < n; ++i) {
+		table_entry_t *summary = r->merge[i];
+		int area = summary_area(summary->dest_id);
+		for (j = find_remote_area(r, area); j < r->num_remote && r->remote[j].area == area; ++j) {
+			remote_member_t *member = &r->remote[j];
+			table_entry_t *route;
+			if (r->remote_pass[member->router] == r->pass) {
+				continue;
+			}
+			r->remote_pass[member->router] = r->pass;
+			route = &r->remote_routes[k++];
+			memcpy(route, summary, sizeof(table_entry_t));
+			memcpy(route->dest_id, member->id, MAX_ID_LEN);
+		}
+	}
+
+	for (i = 0; i < k; ++i) {
+		vector_add(table, &r->remote_routes[i], sizeof(table_entry_t));
+	}
+	from = (int) m - 1;
+	to = (int) k - 1;
+	for (w = (int) (m + k) - 1; to >= 0; --w) {
+		table_entry_t *entry = from >= 0 ? vector_get(table, from) : NULL;
+		if (entry != NULL && entry->cost > r->remote_routes[to].cost) {
+			memcpy(vector_get(table, w), entry, sizeof(table_entry_t));
+			--from;
+		} else {
+			memcpy(vector_get(table, w), &r->remote_routes[to], sizeof(table_entry_t));
+			--to;
+		}
+	}
+}
+
+/* Returns the cost of our most expensive route to a router in area, which
+   is what we advertise for reaching the area as a whole */
+static unsigned int area_cost(router_area_t *area) {
+	unsigned int cost = 0;
+	unsigned int i;
+	for (i = 0; i < area->routes->length; ++i) {
+		table_entry_t *entry = vector_get(area->routes, i);
+		if (summary_area(entry->dest_id) < 0 && entry->cost > cost) {
+			cost = entry->cost;
+		}
+	}
+	return cost;
+}
+
+/* Appends a summary to the n already in the router's summary space */
+static void add_summary(router_t *r, unsigned int *n, int id, unsigned int cost) {
+	lsp_entry_t *entry;
+	if (*n == r->summary_cap) {
+		r->summary_cap = r->summary_cap > 0 ? r->summary_cap * 2 : MAX_LSP_ENTRIES;
+		r->summaries = realloc(r->summaries, r->summary_cap * sizeof(lsp_entry_t));
+	}
+	entry = &r->summaries[(*n)++];
+	memset(entry->id, '\0', MAX_ID_LEN);
+	snprintf(entry->id, MAX_ID_LEN, "%c%d", AREA_PREFIX, id);
+	entry->cost = cost;
+}
+
+/* Orders summaries by area ID */
+static int compare_summary(const void *a, const void *b) {
+	int x = summary_area(((lsp_entry_t *) a)->id);
+	int y = summary_area(((lsp_entry_t *) b)->id);
+	return x < y ? -1 : x > y;
+}
+
+/* Grows our LSP in an area to n fragments. The new ones start out empty
+   and due to be sent. */
+static void add_fragments(router_t *r, router_area_t *area, int n) {
+	int i;
+	area->fragments = realloc(area->fragments, n * sizeof(lsp_fragment_t));
+	for (i = area->num_fragments; i < n; ++i) {
+		memset(&area->fragments[i], '\0', sizeof(lsp_fragment_t));
+		area->fragments[i].packet.header = build_header(0, r->id, 0, LSP_LENGTH(0), 0, TTL, i, area->id);
+	}
+	area->num_fragments = n;
+}
+
+/* Rewrites the summaries we advertise into each of our areas and marks the
+   fragments that changed to be sent. Each area hears of our other areas,
+   and areas other than the backbone also hear of every area the backbone
+   summarizes. Summaries are kept in order of area ID and split into
+   fragments of MAX_LSP_ENTRIES after the links, so a change to one area's
+   cost only touches one fragment. Fragments left over when there are fewer
+   summaries are sent empty rather than dropped, so their old entries go. */
+static void update_summaries(router_t *r) {
+	router_area_t *backbone = find_area(r, BACKBONE_AREA);
+	unsigned int i;
+	int a;
+	int b;
+	int f;
+
+	for (a = 0; a < r->num_areas; ++a) {
+		router_area_t *area = &r->areas[a];
+		int room = MAX_LSP_FRAGMENTS - area->link_fragments;
+		unsigned int n = 0;
+		int needed;
+
+		for (b = 0; b < r->num_areas; ++b) {
+			if (b != a) {
+				add_summary(r, &n, r->areas[b].id, area_cost(&r->areas[b]));
+			}
+		}
+		if (backbone != NULL && area != backbone) {
+			for (i = 0; i < backbone->routes->length; ++i) {
+				table_entry_t *entry = vector_get(backbone->routes, i);
+				int id = summary_area(entry->dest_id);
+				if (id >= 0 && id != area->id && find_area(r, id) == NULL) {
+					add_summary(r, &n, id, entry->cost);
+				}
+			}
+		}
+		qsort(r->summaries, n, sizeof(lsp_entry_t), compare_summary);
+
+		needed = (n + MAX_LSP_ENTRIES - 1) / MAX_LSP_ENTRIES;
+		if (needed > room) {
+			if (!area->summaries_cut) {
+				fprintf(stderr, "%s: only advertising %d of %u area summaries in area %d\n",
+					r->id, room * MAX_LSP_ENTRIES, n, area->id);
+			}
+			area->summaries_cut = 1;
+			needed = room;
+			n = room * MAX_LSP_ENTRIES;
+		} else {
+			area->summaries_cut = 0;
+		}
+		if (area->link_fragments + needed > area->num_fragments) {
+			add_fragments(r, area, area->link_fragments + needed);
+		}
+
+		for (f = area->link_fragments; f < area->num_fragments; ++f) {
+			lsp_packet_t *packet = &area->fragments[f].packet;
+			unsigned int first = (f - area->link_fragments) * MAX_LSP_ENTRIES;
+			int entries = first >= n ? 0 : n - first < MAX_LSP_ENTRIES ? (int) (n - first) : MAX_LSP_ENTRIES;
+			size_t len = sizeof(lsp_entry_t) * entries;
+
+			if (entries != packet->header.entries ||
+					(entries > 0 && memcmp(packet->data, r->summaries + first, len) != 0)) {
+				if (entries > 0) {
+					memcpy(packet->data, r->summaries + first, len);
+				}
+				packet->header.entries = entries;
+				packet->header.length = LSP_LENGTH(entries);
+				area->fragments[f].dirty = 1;
+			}
+		}
+	}
+}
+
+/* Recomputes the routing table from the LSDBs. Returns 1 if it changed. The
+   new table is built in the spare and the two swap places, so neither the
+   tables nor their entries are allocated in steady state. A border router
+   only recomputes the areas that changed, merges their routes and updates
+   its summaries. Routers of other areas are added last. */
+int update_routing_table(router_t *r) {
+	vector_p table = r->spare_table;
+	unsigned int i;
+	int a;
+
+	vector_clear(table);
+
+	if (r->num_areas == 1) {
+		compute_routes(r, &r->areas[0], table);
+	} else {
+		for (a = 0; a < r->num_areas; ++a) {
+			router_area_t *area = &r->areas[a];
+			if (area->stale) {
+				vector_clear(area->routes);
+				compute_routes(r, area, area->routes);
+				area->stale = 0;
+			}
+		}
+		merge_routes(r, table);
+		update_summaries(r);
+	}
+	add_remote_routes(r, table);
+
+	if (table->length == r->routing_table->length) {
+		for (i = 0; i < table->length; ++i) {
+			if (memcmp(vector_get(table, i), vector_get(r->routing_table, i), sizeof(table_entry_t)) != 0) {
+				break;
+			}
+		}
+		if (i == table->length) {
+			return 0;
+		}
+	}
+
+	if (r->feed != NULL) {
+		feed_publish(r->feed, r->routing_table, table);
+	}
+	if (r->query != NULL) {
+		query_update(r->query, table);
+	}
+	r->spare_table = r->routing_table;
+	r->routing_table = table;
+	return 1;
+}
+
+void log_lsp(FILE *fp, lsp_packet_t *packet) {
+	int i;
+	fprintf(fp, "LSP\n");
+	fprintf(fp, "SOURCE: %s\n", packet->header.src_id);
+	fprintf(fp, "FRAGMENT: %d\n", packet->header.fragment);
+	if (packet->header.area != BACKBONE_AREA) {
+		fprintf(fp, "AREA: %d\n", packet->header.area);
+	}
+	fprintf(fp, "TIME: %ld\n", time(NULL));
+	fprintf(fp, " ID | COST\n");
+	fprintf(fp, "----------\n");
+	for (i = 0; i < packet->header.entries; ++i) {
+		lsp_entry_t entry = packet->data[i];
+		fprintf(fp, " %s  | %4d\n", entry.id, entry.cost);
+	}
+	fprintf(fp, "\n");
+	fflush(fp);
+}
+
+void log_table(FILE *fp, vector_p table) {
+	unsigned int i;
+	fprintf(fp, "==================================\n");
+	fprintf(fp, "ROUTING TABLE\n");
+	fprintf(fp, "TIME = %ld\n", time(NULL));
+	fprintf(fp, " ID | COST | OUT PORT | DEST PORT \n");
+	fprintf(fp, "----------------------------------\n");
+	for (i = 0; i < table->length; ++i) {
+		table_entry_t *entry = vector_get(table, i);
+		fprintf(fp, "  %s | %4d | %8d | %9d \n", entry->dest_id, entry->cost, entry->out_port, entry->dest_port);
+	}
+	fprintf(fp, "==================================\n\n");
+	fflush(fp);
+}
+
+lsp_packet_t build_kill_packet(char *router_id) {
+	lsp_packet_t kill_packet;
+	memset(&kill_packet, '\0', sizeof(kill_packet));
+	kill_packet.header = build_header(INT_MAX, router_id, FLAG_KILL, LSP_LENGTH(0), 0, TTL, 0, BACKBONE_AREA);
+	return kill_packet;
+}
+
+/* Returns the next of our fragments due to be sent at time now with its
+   sequence number bumped, or NULL if none are. Changed fragments go out
+   straight away, the rest every REFRESH_INTERVAL seconds. */
+lsp_packet_t* refresh_lsp(router_t *r, time_t now) {
+	int a;
+	int i;
+
+	for (a = 0; a < r->num_areas; ++a) {
+		router_area_t *area = &r->areas[a];
+		for (i = 0; i < area->num_fragments; ++i) {
+			lsp_fragment_t *frag = &area->fragments[i];
+			if (frag->dirty || now >= frag->last_sent + REFRESH_INTERVAL) {
+				frag->dirty = 0;
+				frag->last_sent = now;
+				frag->packet.header.seq_num++;
+				return &frag->packet;
+			}
+		}
+	}
+	return NULL;
+}
+
+/* Changes the cost of our link to neighbor id. Returns -1 if there is no
+   such neighbor. */
+int set_link_cost(router_t *r, char *id, int cost) {
+	unsigned int i;
+	unsigned int j;
+	for (i = 0; i < r->neighbors->length; ++i) {
+		table_entry_t *entry = vector_get(r->neighbors, i);
+		if (strncmp(entry->dest_id, id, MAX_ID_LEN) == 0) {
+			router_area_t *area = find_area(r, link_area_id(r, i));
+			for (j = 0; area->links[j] != i; ++j);
+			if ((int) j >= area->link_fragments * MAX_LSP_ENTRIES) {
+				return -1;
+			}
+			entry->cost = cost;
+			((table_entry_t *) vector_get(area->neighbors, j))->cost = cost;
+			fill_fragment(area, j / MAX_LSP_ENTRIES);
+			area->stale = 1;
+			if (update_routing_table(r)) {
+				log_table(r->logfp, r->routing_table);
+			}
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/* Fails (up == 0) or restores the link to neighbor id. Returns -1 if there
+   is no such neighbor. */
+int set_link_state(router_t *r, char *id, int up) {
+	table_entry_t *entry = table_get_by_id(r->neighbors, id);
+	if (entry == NULL) {
+		return -1;
+	}
+	if (LINK_UP(entry) == !up) {
+		return set_link_cost(r, id, ~(int) entry->cost);
+	}
+	return 0;
+}
+
+/* Drops stale fragments from the LSDBs, at most once a second */
+void age_lsdb(router_t *r, time_t now) {
+	int expired = 0;
+	int a;
+
+	if (now == r->last_aged) {
+		return;
+	}
+	r->last_aged = now;
+	for (a = 0; a < r->num_areas; ++a) {
+		if (lsdb_expire(r->areas[a].lsdb, now, MAX_AGE) > 0) {
+			r->areas[a].stale = 1;
+			expired = 1;
+		}
+	}
+	if (expired && update_routing_table(r)) {
+		log_table(r->logfp, r->routing_table);
+	}
+}
+
+/* Processes a received LSP. Returns LSP_FORWARD if the packet should be
+   flooded to every neighbor except ignore_id and LSP_KILL if the router
+   should shut down. now is the time it arrived. */
+int handle_lsp(router_t *r, lsp_packet_t *packet, char *ignore_id, time_t now) {
+	double start = 0;
+	int action = 0;
+
+	r->lsps_recvd++;
+
+	if (packet->header.flags & FLAG_KILL) {  // Kill packet
+		fprintf(r->logfp, "kill packet received\n");
+		log_lsp(r->logfp, packet);
+		strncpy(ignore_id, packet->header.src_id, MAX_ID_LEN);
+		strncpy(packet->header.src_id, r->id, MAX_ID_LEN);
+		action = LSP_KILL;
+
+	} else {  // Regular packet
+		router_area_t *area;
+		int status;
+
+		// Our own fragments flooded back to us carry nothing new, and
+		// neither does an area we have no links in
+		if (strncmp(packet->header.src_id, r->id, MAX_ID_LEN) == 0 ||
+				(area = find_area(r, packet->header.area)) == NULL) {
+			return 0;
+		}
+
+		if (r->timed) {
+			start = router_clock();
+		}
+		status = lsdb_update(area->lsdb, packet, now);
+		stage_done(r, &r->timing.dedup, &start);
+		if (status == LSDB_OLD) {
+			return 0;
+		}
+		log_lsp(r->logfp, packet);
+		stage_done(r, &r->timing.log, &start);
+		if (status == LSDB_CHANGED) {
+			area->stale = 1;
+		}
+		if (status == LSDB_CHANGED && update_routing_table(r)) {
+			stage_done(r, &r->timing.route, &start);
+			log_table(r->logfp, r->routing_table);
+			stage_done(r, &r->timing.log, &start);
+		} else {
+			stage_done(r, &r->timing.route, &start);
+		}
+		strncpy(ignore_id, packet->header.src_id, MAX_ID_LEN);
+	}
+
+	packet->header.ttl--;
+	if (packet->header.ttl > 0) {
+		action |= LSP_FORWARD;
+	}
+	return action;
+}
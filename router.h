@@ -0,0 +1,170 @@
+#ifndef __ROUTER_H__
+#define __ROUTER_H__
+
+/* Router core. Everything a router does with an LSP once it has arrived,
+   from the LSDB update through route computation to the decision to flood
+   it, along with the upkeep of our own LSP. It does no network I/O, so the
+   event loops in routed_LS.c and the trace replay in lsp_replay.c share it.
+
+   Every link belongs to an area. LSPs are flooded only within the area
+   they were sent in, and a router keeps a separate LSDB for each area it
+   has links in, so it only ever learns the routers of its own areas. A
+   border router, one with links in several areas, also advertises into
+   each of its areas one summary entry per area it can reach through the
+   others, named AREA_PREFIX followed by the area ID, whose cost is that of
+   the most expensive route into the area. Summaries fill as many fragments
+   after the links as they need.
+
+   Routers in other areas are reached through the summary of their area.
+   Which areas a router is in comes from the initialization file, which
+   every router reads whole, and the routing table carries a copy of the
+   summary route for each router we share no area with, so anything looking
+   up a router ID finds it wherever it is. */
+
+#include <stdio.h>
+#include <time.h>
+#include "vector.h"
+#include "hashmap.h"
+#include "lsp.h"
+#include "lsdb.h"
+#include "spf.h"
+#include "spf_dense.h"
+#include "feed.h"
+#include "query.h"
+#include "trace.h"
+#include "pool.h"
+
+#define REFRESH_INTERVAL 5
+#define MAX_AGE (4 * REFRESH_INTERVAL)
+#define ENTRIES_PER_SLAB 64
+#define BACKBONE_AREA 0  // Links without an area are in it
+#define AREA_PREFIX '@'
+
+/* A failed link keeps its cost bitwise inverted, which makes it negative.
+   It is advertised that way, route computation skips it, nothing is flooded
+   over it and restoring it brings back the cost it had. */
+#define LINK_UP(entry) ((int) (entry)->cost >= 0)
+
+/* Results of handle_lsp() */
+#define LSP_FORWARD 1
+#define LSP_KILL 2
+
+typedef struct {
+	lsp_packet_t packet;
+	time_t last_sent;
+	int dirty;  // Changed since it was last sent
+} lsp_fragment_t;
+
+/* An area we have links in */
+typedef struct {
+	int id;
+	vector_p neighbors;         // Our links in the area
+	unsigned int *links;        // Index in the router's neighbors of each
+	lsdb_p lsdb;
+	lsp_fragment_t *fragments;  // Our LSP in the area, links then summaries
+	int num_fragments;
+	int link_fragments;         // Fragments that carry links
+	vector_p routes;            // Routes within the area, for border routers
+	int stale;                  // Changed since routes was computed
+	int summaries_cut;          // Summaries did not all fit, already reported
+} router_area_t;
+
+/* A router we share no area with, in one of its areas */
+typedef struct {
+	char id[MAX_ID_LEN];
+	int area;
+	unsigned int router;  // Number of the router, the same in all its areas
+} remote_member_t;
+
+/* Seconds spent in each stage of handle_lsp() */
+typedef struct {
+	double dedup;  // LSDB lookup and update
+	double route;  // Route computation and table comparison
+	double log;    // Writing the log
+} router_timing_t;
+
+typedef struct {
+	char *id;
+	FILE *logfp;
+	vector_p neighbors;
+	vector_p link_areas;  // Area ID of each neighbor's link, as int
+	vector_p routing_table;
+	vector_p spare_table;  // Filled by the next route computation
+	pool_p entries;  // Route entries of both tables
+	hashmap_p socks;  // Maps router IDs to socket FDs
+	router_area_t *areas;
+	int num_areas;
+	vector_p members;  // Every router's areas as area_member_t, NULL if unknown
+	remote_member_t *remote;  // Routers we share no area with, by area then ID
+	unsigned int num_remote;
+	unsigned int *remote_pass;  // Pass each remote router last got a route in
+	unsigned int pass;
+	table_entry_t *remote_routes;  // Their routes, built from the summaries
+	table_entry_t **merge;  // Border router route merging space
+	unsigned int merge_cap;
+	lsp_entry_t *summaries;  // Border router summary building space
+	unsigned int summary_cap;
+	time_t last_aged;
+	feed_p feed;  // Route change subscribers, NULL if disabled
+	query_p query;  // Route lookups, NULL if disabled
+	trace_p trace;  // Received LSP capture, NULL if disabled
+	spf_p spf;  // spf_compute() workspace, kept between computations
+	spf_dense_p dense;  // Dense matrix route computation, NULL for spf_compute()
+	int timed;  // Collect timing
+	router_timing_t timing;
+	unsigned long lsps_recvd;
+	unsigned long recomputes;  // Route computations run
+} router_t;
+
+/* Create the routing table and its spare, which share a pool of entries,
+   and the workspace of spf_compute() */
+void create_tables(router_t *r);
+
+/* Free both routing tables, their entries and the spf_compute() workspace */
+void destroy_tables(router_t *r);
+
+/* Read our links out of the initialization file into neighbors and table,
+   the area of each into areas if it is not NULL, and every router of the
+   file with the area of each of its links into members as area_member_t if
+   that is not NULL */
+void init_router(FILE* fp, char *router_id, vector_p neighbors, vector_p table, vector_p areas, vector_p members);
+
+/* Split our links into areas by link_areas, creating an LSDB for each and
+   building our LSP in each. Set members first for routes to the routers of
+   areas we are not in. */
+void create_areas(router_t *r);
+
+/* Free the areas and everything in them */
+void destroy_areas(router_t *r);
+
+/* Get the area with the given ID, or NULL if we have no links in it */
+router_area_t* find_area(router_t *r, int id);
+
+/* Returns 1 if packet should go out over our link to neighbor i */
+int link_floods(router_t *r, unsigned int i, lsp_packet_t *packet);
+
+lsp_header_t build_header(int seq_num, char *src_id, int flags, int length, int entries, int ttl, int fragment, int area);
+
+int table_contains(vector_p table, char *id);
+
+table_entry_t* table_get_by_id(vector_p table, char *id);
+
+int update_routing_table(router_t *r);
+
+void log_lsp(FILE *fp, lsp_packet_t *packet);
+
+void log_table(FILE *fp, vector_p table);
+
+lsp_packet_t build_kill_packet(char *router_id);
+
+lsp_packet_t* refresh_lsp(router_t *r, time_t now);
+
+int set_link_cost(router_t *r, char *id, int cost);
+
+int set_link_state(router_t *r, char *id, int up);
+
+void age_lsdb(router_t *r, time_t now);
+
+int handle_lsp(router_t *r, lsp_packet_t *packet, char *ignore_id, time_t now);
+
+#endif
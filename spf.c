@@ -0,0 +1,192 @@
+#include "spf.h"
+#include <string.h>
+#include <limits.h>
+
+#define SPF_MIN_NODES 16
+
+typedef struct spf_node {
+	char id[MAX_ID_LEN];
+	unsigned int cost;
+	int hop;  // Index into neighbors of the first hop, -1 if none yet
+	int done;
+} spf_node_t;
+
+typedef struct spf_heap_item {
+	unsigned int cost;
+	int node;
+} spf_heap_item_t;
+
+/* Size the index for the node array and fill it from the nodes numbered */
+static void spf_reindex(spf_p s){
+	int i;
+	s->slots = (int*)realloc(s->slots, sizeof(int) * s->node_cap * 2);
+	s->mask = s->node_cap * 2 - 1;
+	memset(s->slots, 0xff, sizeof(int) * s->node_cap * 2);
+	for(i = 0; i < s->num_nodes; ++i){
+		unsigned int h = lsdb_hash(s->nodes[i].id) & s->mask;
+		while(s->slots[h] >= 0)
+			h = (h + 1) & s->mask;
+		s->slots[h] = i;
+	}
+}
+
+/* Get the node number for id, adding a node if it has not been seen */
+static int spf_node(spf_p s, const char *id){
+	unsigned int h = lsdb_hash(id) & s->mask;
+	spf_node_t *node;
+	int n;
+
+	while((n = s->slots[h]) >= 0){
+		if(strncmp(s->nodes[n].id, id, MAX_ID_LEN - 1) == 0)
+			return n;
+		h = (h + 1) & s->mask;
+	}
+
+	n = s->num_nodes++;
+	node = &s->nodes[n];
+	memset(node->id, '\0', MAX_ID_LEN);
+	strncpy(node->id, id, MAX_ID_LEN - 1);
+	node->cost = UINT_MAX;
+	node->hop = -1;
+	node->done = 0;
+	s->slots[h] = n;
+
+	// Keep room for the next one, and the index at most half full
+	if(s->num_nodes == s->node_cap){
+		s->node_cap *= 2;
+		s->nodes = (spf_node_t*)realloc(s->nodes, sizeof(spf_node_t) * s->node_cap);
+		spf_reindex(s);
+	}
+	return n;
+}
+
+static void spf_push(spf_p s, unsigned int cost, int node){
+	int i;
+	if(s->heap_len == s->heap_cap){
+		s->heap_cap *= 2;
+		s->heap = (spf_heap_item_t*)realloc(s->heap, sizeof(spf_heap_item_t) * s->heap_cap);
+	}
+	i = s->heap_len++;
+	while(i > 0 && s->heap[(i - 1) / 2].cost > cost){
+		s->heap[i] = s->heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	s->heap[i].cost = cost;
+	s->heap[i].node = node;
+}
+
+static spf_heap_item_t spf_pop(spf_p s){
+	spf_heap_item_t top = s->heap[0];
+	spf_heap_item_t last = s->heap[--s->heap_len];
+	int i = 0;
+	int child;
+
+	while((child = 2 * i + 1) < s->heap_len){
+		if(child + 1 < s->heap_len && s->heap[child + 1].cost < s->heap[child].cost)
+			child++;
+		if(last.cost <= s->heap[child].cost)
+			break;
+		s->heap[i] = s->heap[child];
+		i = child;
+	}
+	s->heap[i] = last;
+	return top;
+}
+
+static unsigned int spf_hop_port(spf_p s, int hop){
+	table_entry_t *entry = vector_get(s->neighbors, hop);
+	return entry->dest_port;
+}
+
+/* Offer node v a path of the given cost through first hop 'hop' */
+static void spf_relax(spf_p s, int v, unsigned int cost, int hop){
+	spf_node_t *node = &s->nodes[v];
+	if(node->done)
+		return;
+	if(cost < node->cost || (cost == node->cost &&
+			spf_hop_port(s, hop) < spf_hop_port(s, node->hop))){
+		node->cost = cost;
+		node->hop = hop;
+		spf_push(s, cost, v);
+	}
+}
+
+spf_p create_spf(){
+	spf_p s = (spf_p)calloc(1, sizeof(struct spf));
+	s->node_cap = SPF_MIN_NODES;
+	s->nodes = (spf_node_t*)malloc(sizeof(spf_node_t) * s->node_cap);
+	s->heap_cap = SPF_MIN_NODES;
+	s->heap = (spf_heap_item_t*)malloc(sizeof(spf_heap_item_t) * s->heap_cap);
+	spf_reindex(s);
+	return s;
+}
+
+void spf_compute(spf_p s, lsdb_p db, char *root_id, vector_p neighbors, vector_p table){
+	unsigned int i;
+
+	// Start over in the space the last run left behind
+	s->num_nodes = 0;
+	s->heap_len = 0;
+	s->neighbors = neighbors;
+	memset(s->slots, 0xff, sizeof(int) * (s->mask + 1));
+
+	spf_node(s, root_id);
+	s->nodes[0].cost = 0;
+	s->nodes[0].done = 1;
+
+	// The root's links are known locally, not from its own LSP
+	for(i = 0; i < neighbors->length; ++i){
+		table_entry_t *entry = vector_get(neighbors, i);
+		if((int)entry->cost < 0)
+			continue;
+		spf_relax(s, spf_node(s, entry->dest_id), entry->cost, i);
+	}
+
+	while(s->heap_len > 0){
+		spf_heap_item_t item = spf_pop(s);
+		spf_node_t *node = &s->nodes[item.node];
+		lsdb_router_t *router;
+		table_entry_t *hop;
+		table_entry_t entry;
+		int hop_index;
+		unsigned int cost;
+		int f;
+		int e;
+
+		// Stale heap entry, a cheaper path was already settled
+		if(node->done || item.cost != node->cost)
+			continue;
+		node->done = 1;
+
+		hop_index = node->hop;
+		cost = node->cost;
+		hop = vector_get(neighbors, hop_index);
+		memcpy(entry.dest_id, node->id, MAX_ID_LEN);
+		entry.cost = cost;
+		entry.out_port = hop->out_port;
+		entry.dest_port = hop->dest_port;
+		vector_add(table, &entry, sizeof(table_entry_t));
+
+		if((router = lsdb_get(db, entry.dest_id)) == NULL)
+			continue;
+		for(f = 0; f < router->num_fragments; ++f){
+			lsdb_fragment_t *frag = router->fragments[f];
+			if(frag == NULL)
+				continue;
+			for(e = 0; e < frag->entries; ++e){
+				if(frag->data[e].cost < 0)
+					continue;
+				// spf_node() may move the node array
+				spf_relax(s, spf_node(s, frag->data[e].id),
+						cost + frag->data[e].cost, hop_index);
+			}
+		}
+	}
+}
+
+void destroy_spf(spf_p s){
+	free(s->nodes);
+	free(s->heap);
+	free(s->slots);
+	free(s);
+}
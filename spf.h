@@ -0,0 +1,49 @@
+#ifndef __SPF_H__
+#define __SPF_H__
+
+/* Shortest path first route computation over the link state database */
+
+#include "vector.h"
+#include "lsdb.h"
+
+typedef struct {
+	char dest_id[MAX_ID_LEN];
+	unsigned int cost;
+	unsigned int out_port;
+	unsigned int dest_port;
+} table_entry_t;
+
+struct spf_node;
+struct spf_heap_item;
+
+/* Working space of the computation. It is kept between runs and only grows
+   when the topology does, so steady state runs do not allocate. */
+struct spf{
+	struct spf_node *nodes;
+	int num_nodes;
+	int node_cap;
+	struct spf_heap_item *heap;
+	int heap_len;
+	int heap_cap;
+	int *slots;              // Open addressing index into nodes
+	unsigned int mask;
+	vector_p neighbors;
+};
+
+typedef struct spf * spf_p;
+
+/* Create an empty workspace. It must be destroyed by destroy_spf(). */
+spf_p create_spf();
+
+/* Run Dijkstra's algorithm from root_id over the database. The root's own
+   links come from neighbors, a vector of table_entry_t. One table_entry_t
+   is added to table for every reachable router, in order of increasing
+   cost, carrying the ports of the first hop towards it. Equal cost paths
+   are broken in favor of the lower destination port. Links whose cost is
+   negative, as an int, are down and skipped. */
+void spf_compute(spf_p s, lsdb_p db, char *root_id, vector_p neighbors, vector_p table);
+
+/* Free all of the memory associated with s */
+void destroy_spf(spf_p s);
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ * spf_bench.c
+ *
+ * Compares the heap based and dense matrix route computations on random
+ * topologies of growing size, checks that they agree, and reports where the
+ * dense engine stops being the faster of the two.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "vector.h"
+#include "lsp.h"
+#include "lsdb.h"
+#include "spf.h"
+#include "spf_dense.h"
+
+#define USAGE "[max routers] [links per router]"
+#define DEFAULT_MAX_ROUTERS 2048
+#define DEFAULT_DEGREE 4
+#define MIN_ROUTERS 8
+#define MAX_COST 10
+#define RUN_TIME 0.2  // Seconds to spend timing each engine at each size
+
+double now_sec() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void router_name(char *buf, int n) {
+	snprintf(buf, MAX_ID_LEN, "R%d", n);
+}
+
+/* Builds a ring of n routers with extra random links so every router has
+   about degree links, and stores every router's LSP except R0's. R0's own
+   links go into neighbors. */
+void build_topology(int n, int degree, lsdb_p db, vector_p neighbors) {
+	lsp_packet_t *packets = calloc(n, sizeof(lsp_packet_t));
+	int i;
+	int k;
+
+	for (i = 0; i < n; ++i) {
+		router_name(packets[i].header.src_id, i);
+		packets[i].header.seq_num = 1;
+		packets[i].header.ttl = TTL;
+	}
+
+	// Links are added in both directions with the same cost
+	for (i = 0; i < n; ++i) {
+		for (k = 0; k < degree / 2; ++k) {
+			int j = k == 0 ? (i + 1) % n : rand() % n;
+			int cost = 1 + rand() % MAX_COST;
+			lsp_header_t *a = &packets[i].header;
+			lsp_header_t *b = &packets[j].header;
+			if (j == i || a->entries == MAX_LSP_ENTRIES || b->entries == MAX_LSP_ENTRIES) {
+				continue;
+			}
+			router_name(packets[i].data[a->entries].id, j);
+			packets[i].data[a->entries++].cost = cost;
+			router_name(packets[j].data[b->entries].id, i);
+			packets[j].data[b->entries++].cost = cost;
+		}
+	}
+
+	for (k = 0; k < packets[0].header.entries; ++k) {
+		table_entry_t entry;
+		memset(&entry, '\0', sizeof(entry));
+		strncpy(entry.dest_id, packets[0].data[k].id, MAX_ID_LEN - 1);
+		entry.cost = packets[0].data[k].cost;
+		entry.out_port = 10000 + k;
+		entry.dest_port = 20000 + k;
+		vector_add(neighbors, &entry, sizeof(entry));
+	}
+	for (i = 1; i < n; ++i) {
+		packets[i].header.length = LSP_LENGTH(packets[i].header.entries);
+		lsdb_update(db, &packets[i], time(NULL));
+	}
+	free(packets);
+}
+
+/* Returns microseconds per route computation over the topology, with the
+   dense engine if d is set and spf_compute() in s otherwise, leaving the
+   last table computed in table */
+double time_spf(spf_p s, spf_dense_p d, lsdb_p db, vector_p neighbors, vector_p table) {
+	double start = now_sec();
+	double elapsed;
+	long runs = 0;
+
+	do {
+		while (table->length > 0) {
+			vector_remove(table, table->length - 1);
+		}
+		if (d != NULL) {
+			spf_dense_compute(d, db, "R0", neighbors, table);
+		} else {
+			spf_compute(s, db, "R0", neighbors, table);
+		}
+		++runs;
+	} while ((elapsed = now_sec() - start) < RUN_TIME);
+	return elapsed * 1e6 / runs;
+}
+
+/* Returns 1 if both tables hold the same routes, in any order */
+int same_routes(vector_p a, vector_p b) {
+	unsigned int i;
+	unsigned int j;
+
+	if (a->length != b->length) {
+		return 0;
+	}
+	for (i = 0; i < a->length; ++i) {
+		table_entry_t *x = vector_get(a, i);
+		for (j = 0; j < b->length; ++j) {
+			table_entry_t *y = vector_get(b, j);
+			if (strncmp(x->dest_id, y->dest_id, MAX_ID_LEN) == 0) {
+				break;
+			}
+		}
+		if (j == b->length || memcmp(x, vector_get(b, j), sizeof(table_entry_t)) != 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int main(int argc, char *argv[]) {
+	int max_routers = DEFAULT_MAX_ROUTERS;
+	int degree = DEFAULT_DEGREE;
+	int dense_up_to = 0;  // Largest size where the dense engine won
+	int n;
+
+	if (argc > 1) {
+		max_routers = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		degree = atoi(argv[2]);
+	}
+	if (max_routers < MIN_ROUTERS || degree < 2) {
+		fprintf(stderr, "Usage: %s %s\n", argv[0], USAGE);
+		return EXIT_FAILURE;
+	}
+
+	srand(1);
+	printf("routers  width   heap (us)  dense (us)  speedup\n");
+	for (n = MIN_ROUTERS; n <= max_routers; n *= 2) {
+		lsdb_p db = create_lsdb();
+		vector_p neighbors = create_vector();
+		vector_p heap_table = create_vector();
+		vector_p dense_table = create_vector();
+		spf_p heap = create_spf();
+		spf_dense_p dense = create_spf_dense();
+		double heap_us;
+		double dense_us;
+
+		build_topology(n, degree, db, neighbors);
+		heap_us = time_spf(heap, NULL, db, neighbors, heap_table);
+		dense_us = time_spf(NULL, dense, db, neighbors, dense_table);
+
+		printf("%7d  %5d  %10.2f  %10.2f  %6.2fx%s\n", n, spf_dense_width(n),
+			heap_us, dense_us, heap_us / dense_us,
+			same_routes(heap_table, dense_table) ? "" : "  ROUTES DIFFER");
+		if (dense_us < heap_us) {
+			dense_up_to = n;
+		}
+
+		destroy_spf(heap);
+		destroy_spf_dense(dense);
+		destroy_vector(dense_table);
+		destroy_vector(heap_table);
+		destroy_vector(neighbors);
+		destroy_lsdb(db);
+	}
+
+	if (dense_up_to == 0) {
+		printf("heap is faster at every size\n");
+	} else if (dense_up_to * 2 > max_routers) {
+		printf("dense is faster at every size up to %d routers\n", dense_up_to);
+	} else {
+		printf("crossover between %d and %d routers\n", dense_up_to, dense_up_to * 2);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,320 @@
+#include "spf_dense.h"
+#include <stdint.h>
+#include <string.h>
+
+/* Costs are kept as int32. A missing link costs SPF_DENSE_INF, which is
+   large enough that any real path is cheaper and small enough that adding
+   it to a real path cost does not overflow, so paths costing that much or
+   more count as unreachable. Settled and padding nodes carry SPF_DENSE_DONE:
+   no path compares below or equal to it as a signed number, and as an
+   unsigned one it is never the cheapest. */
+#define SPF_DENSE_INF (1 << 30)
+#define SPF_DENSE_DONE -1
+#define SPF_DENSE_ALIGN 64
+#define SPF_DENSE_MAX_WIDTH 16
+#define SPF_DENSE_MIN_NODES 64
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SPF_DENSE_AVX2 __attribute__((target("avx2")))
+#define SPF_DENSE_AVX512 __attribute__((target("avx512f")))
+#define SPF_DENSE_HAVE(isa) __builtin_cpu_supports(isa)
+#else
+#define SPF_DENSE_AVX2
+#define SPF_DENSE_AVX512
+#define SPF_DENSE_HAVE(isa) 0
+#endif
+
+/* Defines spf_dense_min_W() and spf_dense_relax_W() working W lanes at a
+   time over the first n nodes. key, hop and row are SPF_DENSE_ALIGN aligned
+   and n is a multiple of SPF_DENSE_MAX_WIDTH. */
+#define SPF_DENSE_KERNEL(W, TARGET)                                           \
+typedef int32_t spf_v##W __attribute__((vector_size(W * 4)));                 \
+typedef uint32_t spf_u##W __attribute__((vector_size(W * 4)));                \
+                                                                              \
+/* Index of the cheapest unsettled node, the lowest index on a tie, or -1 */  \
+TARGET static int spf_dense_min_##W(const int32_t *key, int n){               \
+	uint32_t lanes[W] __attribute__((aligned(SPF_DENSE_ALIGN)));              \
+	uint32_t where[W] __attribute__((aligned(SPF_DENSE_ALIGN)));              \
+	spf_u##W best = *(const spf_u##W*)key;                                    \
+	spf_u##W best_i;                                                          \
+	spf_u##W idx;                                                             \
+	uint32_t min = SPF_DENSE_INF;                                             \
+	int found = -1;                                                           \
+	int i;                                                                    \
+                                                                              \
+	for(i = 0; i < W; ++i)                                                    \
+		lanes[i] = i;                                                         \
+	idx = best_i = *(spf_u##W*)lanes;                                         \
+	for(i = W; i < n; i += W){                                                \
+		spf_u##W k = *(const spf_u##W*)(key + i);                             \
+		spf_u##W lt;                                                          \
+		idx += W;                                                             \
+		lt = (spf_u##W)(k < best);                                            \
+		best = (k & lt) | (best & ~lt);                                       \
+		best_i = (idx & lt) | (best_i & ~lt);                                 \
+	}                                                                         \
+                                                                              \
+	*(spf_u##W*)lanes = best;                                                 \
+	*(spf_u##W*)where = best_i;                                               \
+	for(i = 0; i < W; ++i){                                                   \
+		if(lanes[i] < min || (lanes[i] == min && found >= 0 &&                \
+				(int)where[i] < found)){                                          \
+			min = lanes[i];                                                   \
+			found = where[i];                                                 \
+		}                                                                     \
+	}                                                                         \
+	return found;                                                             \
+}                                                                             \
+                                                                              \
+/* Offer every node the path through node u, reached at cost du through     \
+   first hop hu, along u's row of the matrix */                               \
+TARGET static void spf_dense_relax_##W(const int32_t *row, int32_t *key,      \
+				int32_t *hop, int n, int32_t du, int32_t hu){                     \
+	int i;                                                                    \
+	for(i = 0; i < n; i += W){                                                \
+		spf_v##W nd = *(const spf_v##W*)(row + i) + du;                       \
+		spf_v##W k = *(spf_v##W*)(key + i);                                   \
+		spf_v##W h = *(spf_v##W*)(hop + i);                                   \
+		spf_v##W m = (nd < k) | ((nd == k) & (h > hu));                       \
+		*(spf_v##W*)(key + i) = (nd & m) | (k & ~m);                          \
+		*(spf_v##W*)(hop + i) = (hu & m) | (h & ~m);                          \
+	}                                                                         \
+}
+
+SPF_DENSE_KERNEL(4, )
+SPF_DENSE_KERNEL(8, SPF_DENSE_AVX2)
+SPF_DENSE_KERNEL(16, SPF_DENSE_AVX512)
+
+/* Make room for twice as many routers, keeping the links already stored.
+   Links only ever go to numbered routers, so every column from num_nodes
+   on holds SPF_DENSE_INF. */
+static void spf_dense_grow(spf_dense_p d){
+	size_t stride = d->stride > 0 ? d->stride * 2 : SPF_DENSE_MIN_NODES;
+	int32_t *matrix = aligned_alloc(SPF_DENSE_ALIGN, sizeof(int32_t) * stride * stride);
+	size_t i;
+	size_t j;
+
+	for(i = 0; i < stride; ++i){
+		for(j = 0; j < stride; ++j)
+			matrix[i * stride + j] = i < d->stride && j < d->stride ?
+						d->matrix[i * d->stride + j] : SPF_DENSE_INF;
+	}
+	free(d->matrix);
+	free(d->key);
+	free(d->hop);
+	d->matrix = matrix;
+	d->key = aligned_alloc(SPF_DENSE_ALIGN, sizeof(int32_t) * stride);
+	d->hop = aligned_alloc(SPF_DENSE_ALIGN, sizeof(int32_t) * stride);
+	d->ids = realloc(d->ids, MAX_ID_LEN * stride);
+	d->version = realloc(d->version, sizeof(unsigned long) * stride);
+	d->has_row = realloc(d->has_row, stride);
+	d->used = realloc(d->used, stride);
+	memset(d->version + d->stride, 0, sizeof(unsigned long) * (stride - d->stride));
+	memset(d->has_row + d->stride, 0, stride - d->stride);
+	memset(d->used + d->stride, 0, stride - d->stride);
+	d->stride = stride;
+}
+
+static void spf_dense_reindex(spf_dense_p d, unsigned int size){
+	int i;
+	d->slots = realloc(d->slots, sizeof(int) * size);
+	d->mask = size - 1;
+	memset(d->slots, 0xff, sizeof(int) * size);
+	for(i = 0; i < d->num_nodes; ++i){
+		unsigned int h = lsdb_hash(d->ids[i]) & d->mask;
+		while(d->slots[h] >= 0)
+			h = (h + 1) & d->mask;
+		d->slots[h] = i;
+	}
+}
+
+/* Get the number of router id, numbering it if it has not been seen */
+static int spf_dense_node(spf_dense_p d, const char *id){
+	unsigned int h = lsdb_hash(id) & d->mask;
+	int n;
+
+	while((n = d->slots[h]) >= 0){
+		if(strncmp(d->ids[n], id, MAX_ID_LEN - 1) == 0){
+			d->used[n] = 1;
+			return n;
+		}
+		h = (h + 1) & d->mask;
+	}
+
+	if((size_t)d->num_nodes == d->stride)
+		spf_dense_grow(d);
+	n = d->num_nodes++;
+	memset(d->ids[n], '\0', MAX_ID_LEN);
+	strncpy(d->ids[n], id, MAX_ID_LEN - 1);
+	d->used[n] = 1;
+	d->slots[h] = n;
+	if((unsigned int)d->num_nodes * 2 > d->mask)
+		spf_dense_reindex(d, (d->mask + 1) * 2);
+	return n;
+}
+
+spf_dense_p create_spf_dense(){
+	spf_dense_p d = (spf_dense_p)calloc(1, sizeof(struct spf_dense));
+	spf_dense_grow(d);
+	spf_dense_reindex(d, SPF_DENSE_MIN_NODES * 2);
+	return d;
+}
+
+int spf_dense_width(unsigned int nodes){
+	static int avx2 = -1;
+	static int avx512 = -1;
+
+	if(avx2 < 0){
+		avx2 = SPF_DENSE_HAVE("avx2");
+		avx512 = SPF_DENSE_HAVE("avx512f");
+	}
+	if(nodes >= 64 && avx512)
+		return 16;
+	if(nodes >= 16 && avx2)
+		return 8;
+	return 4;
+}
+
+void spf_dense_compute(spf_dense_p d, lsdb_p db, char *root_id, vector_p neighbors, vector_p table){
+	size_t stride;
+	int n;
+	unsigned int i;
+	unsigned int j;
+	int live = 0;
+	int width;
+	int root;
+	int u;
+	int f;
+	int e;
+
+	memset(d->has_row, 0, d->num_nodes);
+	memset(d->used, 0, d->num_nodes);
+
+	// Number every router and rewrite the rows of those in the LSDB whose
+	// adjacencies changed since their row was written
+	root = spf_dense_node(d, root_id);
+	for(i = 0; i < neighbors->length; ++i)
+		spf_dense_node(d, ((table_entry_t*)vector_get(neighbors, i))->dest_id);
+	for(i = 0; i < (unsigned int)db->num_routers; ++i){
+		lsdb_router_t *router = db->routers[i];
+		int32_t *row;
+
+		u = spf_dense_node(d, router->id);
+		d->has_row[u] = 1;
+		if(d->version[u] == router->version)
+			continue;
+		d->version[u] = router->version;
+		row = d->matrix + d->stride * u;
+		for(j = 0; j < (unsigned int)d->num_nodes; ++j)
+			row[j] = SPF_DENSE_INF;
+		for(f = 0; f < router->num_fragments; ++f){
+			lsdb_fragment_t *frag = router->fragments[f];
+			if(frag == NULL)
+				continue;
+			for(e = 0; e < frag->entries; ++e){
+				int32_t cost = frag->data[e].cost;
+				int v = spf_dense_node(d, frag->data[e].id);
+				row = d->matrix + d->stride * u;  // Numbering may grow the matrix
+				if(cost >= 0 && cost < row[v])
+					row[v] = cost;
+			}
+		}
+	}
+	stride = d->stride;
+	n = (d->num_nodes + SPF_DENSE_MAX_WIDTH - 1) & ~(SPF_DENSE_MAX_WIDTH - 1);
+
+	for(i = 0; i < (unsigned int)n; ++i){
+		d->key[i] = (int)i < d->num_nodes ? SPF_DENSE_INF : SPF_DENSE_DONE;
+		d->hop[i] = INT32_MAX;  // Loses every tie
+		live += d->used[i];
+	}
+	d->key[root] = SPF_DENSE_DONE;
+
+	// First hops are ranked by destination port, so the lower rank wins a
+	// tie just as the lower port does in spf_compute()
+	if(neighbors->length > d->rank_cap){
+		d->rank_cap = neighbors->length;
+		d->by_rank = realloc(d->by_rank, sizeof(int) * d->rank_cap);
+	}
+	for(i = 0; i < neighbors->length; ++i){
+		unsigned int port = ((table_entry_t*)vector_get(neighbors, i))->dest_port;
+		int rank = 0;
+		for(j = 0; j < neighbors->length; ++j){
+			unsigned int other = ((table_entry_t*)vector_get(neighbors, j))->dest_port;
+			if(other < port || (other == port && j < i))
+				++rank;
+		}
+		d->by_rank[rank] = i;
+	}
+	for(i = 0; i < neighbors->length; ++i){
+		table_entry_t *entry = vector_get(neighbors, d->by_rank[i]);
+		int v = spf_dense_node(d, entry->dest_id);
+		int32_t cost = entry->cost;
+		if(d->key[v] != SPF_DENSE_DONE && cost >= 0 && cost < d->key[v]){
+			d->key[v] = cost;
+			d->hop[v] = i;
+		}
+	}
+
+	width = spf_dense_width(live);
+	for(;;){
+		table_entry_t *first;
+		table_entry_t entry;
+		int32_t du;
+
+		if(width == 16)
+			u = spf_dense_min_16(d->key, n);
+		else if(width == 8)
+			u = spf_dense_min_8(d->key, n);
+		else
+			u = spf_dense_min_4(d->key, n);
+		if(u < 0)
+			break;
+
+		du = d->key[u];
+		d->key[u] = SPF_DENSE_DONE;
+		first = vector_get(neighbors, d->by_rank[d->hop[u]]);
+		memcpy(entry.dest_id, d->ids[u], MAX_ID_LEN);
+		entry.cost = du;
+		entry.out_port = first->out_port;
+		entry.dest_port = first->dest_port;
+		vector_add(table, &entry, sizeof(table_entry_t));
+
+		if(!d->has_row[u])
+			continue;
+		if(width == 16)
+			spf_dense_relax_16(d->matrix + stride * u, d->key, d->hop, n, du, d->hop[u]);
+		else if(width == 8)
+			spf_dense_relax_8(d->matrix + stride * u, d->key, d->hop, n, du, d->hop[u]);
+		else
+			spf_dense_relax_4(d->matrix + stride * u, d->key, d->hop, n, du, d->hop[u]);
+	}
+
+	// Routers that have left the topology keep their numbers until there
+	// are enough of them to be worth renumbering from scratch. Every row is
+	// rewritten after that, and the columns of the old numbers cleared.
+	if(d->num_nodes > 2 * live + SPF_DENSE_MIN_NODES){
+		for(u = 0; u < d->num_nodes; ++u){
+			for(j = 0; j < (unsigned int)d->num_nodes; ++j)
+				d->matrix[stride * u + j] = SPF_DENSE_INF;
+		}
+		memset(d->version, 0, sizeof(unsigned long) * d->num_nodes);
+		memset(d->has_row, 0, d->num_nodes);
+		memset(d->used, 0, d->num_nodes);
+		d->num_nodes = 0;
+		spf_dense_reindex(d, d->mask + 1);
+	}
+}
+
+void destroy_spf_dense(spf_dense_p d){
+	free(d->ids);
+	free(d->version);
+	free(d->slots);
+	free(d->matrix);
+	free(d->key);
+	free(d->hop);
+	free(d->has_row);
+	free(d->used);
+	free(d->by_rank);
+	free(d);
+}
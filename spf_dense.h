@@ -0,0 +1,58 @@
+#ifndef __SPF_DENSE_H__
+#define __SPF_DENSE_H__
+
+/* Dense matrix route computation. An alternative to spf_compute() that
+   keeps link costs in an aligned matrix indexed by router number and runs
+   Dijkstra's algorithm over it with vector instructions: each step finds
+   the cheapest unsettled router with a vector min-reduction and relaxes its
+   whole row at once. Work grows with the square of the number of routers
+   rather than with the number of links, so it can only pay off for small
+   topologies; spf_bench shows whether it does.
+
+   Kernels are compiled for 4, 8 and 16 costs per instruction and the
+   widest one the CPU supports that suits the topology size is picked at
+   run time. Router numbers and the matrix are kept between computations so
+   steady state runs do not allocate, and only the rows of routers whose
+   adjacencies changed since the last computation are rewritten. The kernels
+   only cover the routers numbered, rounded up to the widest vector. */
+
+#include <stdint.h>
+#include "vector.h"
+#include "lsdb.h"
+#include "spf.h"
+
+struct spf_dense{
+	char (*ids)[MAX_ID_LEN];  // Router ID of each number
+	int num_nodes;
+	int *slots;               // Open addressing index into ids
+	unsigned int mask;
+	size_t stride;            // Routers the matrix has room for
+	int32_t *matrix;          // stride x stride link costs
+	int32_t *key;             // Tentative cost of each router
+	int32_t *hop;             // First hop rank of each router
+	unsigned long *version;   // LSDB version each row was written from, 0 if none
+	char *has_row;            // Router has links in the LSDB
+	char *used;               // Router was seen by the last computation
+	int *by_rank;             // Neighbor index of each first hop rank
+	unsigned int rank_cap;
+};
+
+typedef struct spf_dense * spf_dense_p;
+
+/* Create an engine with no routers numbered yet. It must be destroyed by
+   destroy_spf_dense(). */
+spf_dense_p create_spf_dense();
+
+/* Same contract as spf_compute(), except that routers of equal cost may
+   come out in a different order and paths costing 2^30 or more count as
+   unreachable */
+void spf_dense_compute(spf_dense_p d, lsdb_p db, char *root_id, vector_p neighbors, vector_p table);
+
+/* Get the vector width, in costs, used for a topology of the given number
+   of routers on this CPU */
+int spf_dense_width(unsigned int nodes);
+
+/* Free all of the memory associated with d */
+void destroy_spf_dense(spf_dense_p d);
+
+#endif
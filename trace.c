@@ -0,0 +1,174 @@
+#include "trace.h"
+#include <sys/time.h>
+#include <string.h>
+
+#define TRACE_BUF_SIZE 65536
+#define TRACE_PAD(len) (((len) + 7) & ~(size_t)7)
+
+static void trace_write(trace_p t, int type, int neighbor, const void *data, size_t len){
+	static const char zeros[8];
+	trace_record_t rec;
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	rec.time = (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+	rec.type = type;
+	rec.neighbor = neighbor;
+	rec.len = len;
+	fwrite(&rec, sizeof(rec), 1, t->fp);
+	fwrite(data, 1, len, t->fp);
+	fwrite(zeros, 1, TRACE_PAD(len) - len, t->fp);
+}
+
+trace_p create_trace(char *path, char *router_id, vector_p neighbors, vector_p areas, vector_p members){
+	static const char zeros[8];
+	trace_header_t header;
+	trace_p t;
+	unsigned int i;
+
+	t = (trace_p)calloc(1, sizeof(struct trace));
+	if((t->fp = fopen(path, "w")) == NULL){
+		perror("fopen");
+		free(t);
+		return NULL;
+	}
+	setvbuf(t->fp, NULL, _IOFBF, TRACE_BUF_SIZE);
+	strncpy(t->router_id, router_id, MAX_ID_LEN - 1);
+
+	memset(&header, '\0', sizeof(header));
+	header.magic = TRACE_MAGIC;
+	header.version = TRACE_VERSION;
+	strncpy(header.router_id, router_id, MAX_ID_LEN - 1);
+	header.num_neighbors = neighbors->length;
+	header.num_members = members != NULL ? members->length : 0;
+	fwrite(&header, sizeof(header), 1, t->fp);
+	for(i = 0; i < neighbors->length; ++i)
+		fwrite(vector_get(neighbors, i), sizeof(table_entry_t), 1, t->fp);
+	for(i = 0; i < neighbors->length; ++i){
+		uint32_t area = *(int*)vector_get(areas, i);
+		fwrite(&area, sizeof(area), 1, t->fp);
+	}
+	fwrite(zeros, 1, TRACE_PAD(neighbors->length * sizeof(uint32_t)) - neighbors->length * sizeof(uint32_t), t->fp);
+	for(i = 0; i < header.num_members; ++i)
+		fwrite(vector_get(members, i), sizeof(area_member_t), 1, t->fp);
+	return t;
+}
+
+void trace_lsp(trace_p t, int neighbor, lsp_packet_t *packet){
+	trace_write(t, TRACE_LSP, neighbor, packet, packet->header.length);
+}
+
+void trace_cost(trace_p t, char *id, int cost){
+	lsp_entry_t entry;
+	memset(&entry, '\0', sizeof(entry));
+	strncpy(entry.id, id, MAX_ID_LEN - 1);
+	entry.cost = cost;
+	trace_write(t, TRACE_COST, 0, &entry, sizeof(entry));
+}
+
+void trace_table(trace_p t, vector_p table){
+	size_t len = sizeof(table_entry_t) * table->length;
+	char *data = (char*)malloc(len + 1);
+	unsigned int i;
+	for(i = 0; i < table->length; ++i)
+		memcpy(data + sizeof(table_entry_t) * i, vector_get(table, i), sizeof(table_entry_t));
+	trace_write(t, TRACE_TABLE, 0, data, len);
+	free(data);
+}
+
+trace_p load_trace(char *path){
+	trace_header_t header;
+	trace_p t;
+	FILE *fp;
+	long start;
+	long size;
+	unsigned int i;
+
+	if((fp = fopen(path, "r")) == NULL){
+		perror("fopen");
+		return NULL;
+	}
+	if(fread(&header, sizeof(header), 1, fp) != 1 || header.magic != TRACE_MAGIC ||
+			header.version != TRACE_VERSION){
+		fprintf(stderr, "%s is not an LSP trace\n", path);
+		fclose(fp);
+		return NULL;
+	}
+
+	t = (trace_p)calloc(1, sizeof(struct trace));
+	memcpy(t->router_id, header.router_id, MAX_ID_LEN);
+	t->router_id[MAX_ID_LEN - 1] = '\0';
+	t->neighbors = create_vector();
+	for(i = 0; i < header.num_neighbors; ++i){
+		table_entry_t entry;
+		if(fread(&entry, sizeof(entry), 1, fp) != 1){
+			fprintf(stderr, "%s is truncated\n", path);
+			fclose(fp);
+			destroy_trace(t);
+			return NULL;
+		}
+		vector_add(t->neighbors, &entry, sizeof(entry));
+	}
+	t->areas = create_vector();
+	for(i = 0; i < header.num_neighbors; ++i){
+		uint32_t area;
+		int id;
+		if(fread(&area, sizeof(area), 1, fp) != 1){
+			fprintf(stderr, "%s is truncated\n", path);
+			fclose(fp);
+			destroy_trace(t);
+			return NULL;
+		}
+		id = area;
+		vector_add(t->areas, &id, sizeof(id));
+	}
+	fseek(fp, TRACE_PAD(header.num_neighbors * sizeof(uint32_t)) - header.num_neighbors * sizeof(uint32_t), SEEK_CUR);
+	t->members = create_vector();
+	for(i = 0; i < header.num_members; ++i){
+		area_member_t member;
+		if(fread(&member, sizeof(member), 1, fp) != 1){
+			fprintf(stderr, "%s is truncated\n", path);
+			fclose(fp);
+			destroy_trace(t);
+			return NULL;
+		}
+		member.id[MAX_ID_LEN - 1] = '\0';
+		vector_add(t->members, &member, sizeof(member));
+	}
+
+	// Slurp the records so replay never waits on the disk
+	start = ftell(fp);
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp) - start;
+	fseek(fp, start, SEEK_SET);
+	t->data = (char*)malloc(size + 1);
+	t->len = fread(t->data, 1, size, fp);
+	fclose(fp);
+	return t;
+}
+
+int trace_next(trace_p t, trace_record_t *rec, void **data){
+	if(t->offset == t->len)
+		return 0;
+	if(t->len - t->offset < sizeof(trace_record_t))
+		return -1;
+	memcpy(rec, t->data + t->offset, sizeof(trace_record_t));
+	if(t->len - t->offset - sizeof(trace_record_t) < TRACE_PAD(rec->len))
+		return -1;
+	*data = t->data + t->offset + sizeof(trace_record_t);
+	t->offset += sizeof(trace_record_t) + TRACE_PAD(rec->len);
+	return 1;
+}
+
+void destroy_trace(trace_p t){
+	if(t->fp != NULL)
+		fclose(t->fp);
+	if(t->neighbors != NULL)
+		destroy_vector(t->neighbors);
+	if(t->areas != NULL)
+		destroy_vector(t->areas);
+	if(t->members != NULL)
+		destroy_vector(t->members);
+	free(t->data);
+	free(t);
+}
@@ -0,0 +1,87 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+/* LSP traces. A router started with -t records every LSP it receives, with
+   the time and the neighbor it arrived from, along with every link cost
+   change and its routing table at exit. lsp_replay feeds a trace back
+   through the router's own packet handling code.
+
+   A trace starts with a trace_header_t followed by the traced router's
+   neighbors as table_entry_t and the area of each link as uint32_t, padded
+   to a multiple of 8, and then the areas of every router in the network as
+   area_member_t. Then come records, each a trace_record_t
+   followed by len bytes of data padded to a multiple of 8:
+     TRACE_LSP    the packet as received, header.length bytes
+     TRACE_COST   an lsp_entry_t with the neighbor and its new cost
+     TRACE_TABLE  the routing table as table_entry_t
+   Everything is in host byte order. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "vector.h"
+#include "lsp.h"
+#include "spf.h"
+
+#define TRACE_MAGIC 0x5450534c  // "LSPT"
+#define TRACE_VERSION 3
+
+/* Record types */
+#define TRACE_LSP 1
+#define TRACE_COST 2
+#define TRACE_TABLE 3
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	char router_id[MAX_ID_LEN];
+	uint32_t num_neighbors;
+	uint32_t num_members;
+} trace_header_t;
+
+typedef struct {
+	uint64_t time;      // Microseconds since the epoch
+	uint16_t type;
+	uint16_t neighbor;  // Index of the neighbor a TRACE_LSP arrived from
+	uint32_t len;
+} trace_record_t;
+
+struct trace{
+	FILE *fp;            // Open for writing, NULL for a loaded trace
+	char router_id[MAX_ID_LEN];
+	vector_p neighbors;  // The traced router's neighbors as table_entry_t
+	vector_p areas;      // The area of each neighbor's link as int
+	vector_p members;    // Every router's areas as area_member_t
+	char *data;          // A loaded trace
+	size_t len;
+	size_t offset;       // Next record in data
+};
+
+typedef struct trace * trace_p;
+
+/* Start a trace at path for the router with the given neighbors, link
+   areas and members of every area, which may be NULL. Returns NULL on
+   failure. It must be destroyed by destroy_trace(). */
+trace_p create_trace(char *path, char *router_id, vector_p neighbors, vector_p areas, vector_p members);
+
+/* Record packet as received from neighbor number neighbor */
+void trace_lsp(trace_p t, int neighbor, lsp_packet_t *packet);
+
+/* Record a change in the cost of the link to neighbor id */
+void trace_cost(trace_p t, char *id, int cost);
+
+/* Record a routing table, a vector of table_entry_t */
+void trace_table(trace_p t, vector_p table);
+
+/* Read the whole trace at path into memory. Returns NULL if it cannot be
+   read or is not a trace. It must be destroyed by destroy_trace(). */
+trace_p load_trace(char *path);
+
+/* Get the next record of a loaded trace and point data at its contents,
+   which are 8 byte aligned and may be modified. Returns 0 at the end of
+   the trace and -1 if it is truncated. */
+int trace_next(trace_p t, trace_record_t *rec, void **data);
+
+/* Flush and close a trace being written or free a loaded one */
+void destroy_trace(trace_p t);
+
+#endif
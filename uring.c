@@ -0,0 +1,434 @@
+#include "uring.h"
+#include <string.h>
+#include <errno.h>
+
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <stdint.h>
+#include <unistd.h>
+
+struct uring {
+	int fd;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int sq_entries;
+	unsigned int sq_local_tail;
+	struct io_uring_sqe *sqes;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+	struct io_uring_buf_ring *buf_ring;
+	size_t buf_ring_size;
+	char *bufs;
+	unsigned int buf_count;
+	unsigned int buf_size;
+	struct __kernel_timespec ts;
+};
+
+#define URING_BGID 0
+
+uring_p create_uring(unsigned int entries){
+	struct io_uring_params p;
+	uring_p r;
+	char *sq;
+	char *cq;
+
+	memset(&p, 0, sizeof(p));
+	if((r = (uring_p)calloc(1, sizeof(struct uring))) == NULL)
+		return NULL;
+	if((r->fd = syscall(__NR_io_uring_setup, entries, &p)) < 0){
+		free(r);
+		return NULL;
+	}
+
+	r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if(p.features & IORING_FEAT_SINGLE_MMAP){
+		if(r->cq_ring_size > r->sq_ring_size)
+			r->sq_ring_size = r->cq_ring_size;
+		r->cq_ring_size = r->sq_ring_size;
+	}
+
+	r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE,
+					MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if(r->sq_ring == MAP_FAILED){
+		close(r->fd);
+		free(r);
+		return NULL;
+	}
+
+	if(p.features & IORING_FEAT_SINGLE_MMAP){
+		r->cq_ring = r->sq_ring;
+	} else {
+		r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE,
+					MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if(r->cq_ring == MAP_FAILED){
+			munmap(r->sq_ring, r->sq_ring_size);
+			close(r->fd);
+			free(r);
+			return NULL;
+		}
+	}
+
+	r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+					MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if(r->sqes == MAP_FAILED){
+		if(r->cq_ring != r->sq_ring)
+			munmap(r->cq_ring, r->cq_ring_size);
+		munmap(r->sq_ring, r->sq_ring_size);
+		close(r->fd);
+		free(r);
+		return NULL;
+	}
+
+	sq = (char*)r->sq_ring;
+	cq = (char*)r->cq_ring;
+	r->sq_head = (unsigned int*)(sq + p.sq_off.head);
+	r->sq_tail = (unsigned int*)(sq + p.sq_off.tail);
+	r->sq_mask = (unsigned int*)(sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned int*)(sq + p.sq_off.array);
+	r->sq_entries = p.sq_entries;
+	r->sq_local_tail = *r->sq_tail;
+	r->cq_head = (unsigned int*)(cq + p.cq_off.head);
+	r->cq_tail = (unsigned int*)(cq + p.cq_off.tail);
+	r->cq_mask = (unsigned int*)(cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+	return r;
+}
+
+/* Get a zeroed submission entry, flushing the queue to the kernel if it is
+   full. This function is not meant to be called directly. */
+static struct io_uring_sqe* uring_get_sqe(uring_p r){
+	struct io_uring_sqe *sqe;
+	unsigned int head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+	unsigned int index;
+
+	if(r->sq_local_tail - head >= r->sq_entries){
+		if(uring_submit(r, 0) < 0)
+			return NULL;
+		head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+		if(r->sq_local_tail - head >= r->sq_entries)
+			return NULL;
+	}
+
+	index = r->sq_local_tail & *r->sq_mask;
+	sqe = &r->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	r->sq_array[index] = index;
+	r->sq_local_tail++;
+	return sqe;
+}
+
+int uring_reserve(uring_p r, unsigned int n){
+	unsigned int head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+
+	if(n > r->sq_entries)
+		return -1;
+	if(r->sq_local_tail - head + n > r->sq_entries){
+		if(uring_submit(r, 0) < 0)
+			return -1;
+		head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+		if(r->sq_local_tail - head + n > r->sq_entries)
+			return -1;
+	}
+	return 0;
+}
+
+int uring_provide_buffers(uring_p r, unsigned int count, unsigned int size){
+	struct io_uring_buf_reg reg;
+	unsigned int i;
+
+	r->buf_ring_size = count * sizeof(struct io_uring_buf);
+	r->buf_ring = mmap(NULL, r->buf_ring_size, PROT_READ | PROT_WRITE,
+					MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if(r->buf_ring == MAP_FAILED){
+		r->buf_ring = NULL;
+		return -1;
+	}
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uintptr_t)r->buf_ring;
+	reg.ring_entries = count;
+	reg.bgid = URING_BGID;
+	if(syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0){
+		munmap(r->buf_ring, r->buf_ring_size);
+		r->buf_ring = NULL;
+		return -1;
+	}
+
+	if((r->bufs = (char*)malloc((size_t)count * size)) == NULL){
+		syscall(__NR_io_uring_register, r->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+		munmap(r->buf_ring, r->buf_ring_size);
+		r->buf_ring = NULL;
+		return -1;
+	}
+	r->buf_count = count;
+	r->buf_size = size;
+	r->buf_ring->tail = 0;
+	for(i = 0; i < count; ++i)
+		uring_recycle_buffer(r, i);
+	return 0;
+}
+
+void* uring_buffer(uring_p r, int bid){
+	return r->bufs + (size_t)bid * r->buf_size;
+}
+
+void uring_recycle_buffer(uring_p r, int bid){
+	unsigned short tail = r->buf_ring->tail;
+	struct io_uring_buf *buf = &r->buf_ring->bufs[tail & (r->buf_count - 1)];
+	buf->addr = (uintptr_t)uring_buffer(r, bid);
+	buf->len = r->buf_size;
+	buf->bid = bid;
+	__atomic_store_n(&r->buf_ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+int uring_recv_multishot(uring_p r, int fd, void *data){
+	struct io_uring_sqe *sqe = uring_get_sqe(r);
+	if(sqe == NULL)
+		return -1;
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = fd;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URING_BGID;
+	sqe->user_data = (uintptr_t)data;
+	return 0;
+}
+
+/* Wait for the next completion of the probe */
+static int uring_probe_next(uring_p r, uring_event_t *ev){
+	while(!uring_next(r, ev)){
+		if(uring_submit(r, 1) < 0)
+			return -1;
+	}
+	if(ev->bid >= 0)
+		uring_recycle_buffer(r, ev->bid);
+	return 0;
+}
+
+int uring_probe_recv_multishot(uring_p r){
+	uring_event_t ev;
+	int sv[2];
+	int supported = 0;
+	char c = 0;
+
+	if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		return 0;
+	if(write(sv[1], &c, 1) == 1 && uring_recv_multishot(r, sv[0], NULL) == 0 &&
+			uring_probe_next(r, &ev) == 0){
+		supported = ev.res > 0 && ev.more;
+		// Hanging up ends the receive with one last completion
+		shutdown(sv[0], SHUT_RDWR);
+		while(ev.more && uring_probe_next(r, &ev) == 0);
+	}
+	close(sv[0]);
+	close(sv[1]);
+	return supported;
+}
+
+int uring_send(uring_p r, int fd, void *buf, size_t len, int link, void *data){
+	struct io_uring_sqe *sqe = uring_get_sqe(r);
+	if(sqe == NULL)
+		return -1;
+	sqe->opcode = IORING_OP_SEND;
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t)buf;
+	sqe->len = len;
+	sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+	sqe->flags = link ? IOSQE_IO_LINK : 0;
+	sqe->user_data = (uintptr_t)data;
+	return 0;
+}
+
+void uring_end_chain(uring_p r){
+	unsigned int index = (r->sq_local_tail - 1) & *r->sq_mask;
+	if(r->sq_local_tail != *r->sq_tail)
+		r->sqes[index].flags &= ~IOSQE_IO_LINK;
+}
+
+int uring_write(uring_p r, int fd, void *buf, size_t len, off_t offset, void *data){
+	struct io_uring_sqe *sqe = uring_get_sqe(r);
+	if(sqe == NULL)
+		return -1;
+	sqe->opcode = IORING_OP_WRITE;
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t)buf;
+	sqe->len = len;
+	sqe->off = offset;
+	sqe->user_data = (uintptr_t)data;
+	return 0;
+}
+
+int uring_poll(uring_p r, int fd, void *data){
+	return uring_poll_events(r, fd, POLLIN, data);
+}
+
+int uring_poll_events(uring_p r, int fd, unsigned int events, void *data){
+	struct io_uring_sqe *sqe = uring_get_sqe(r);
+	if(sqe == NULL)
+		return -1;
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = events;
+	sqe->user_data = (uintptr_t)data;
+	return 0;
+}
+
+int uring_timeout(uring_p r, long msec, void *data){
+	struct io_uring_sqe *sqe = uring_get_sqe(r);
+	if(sqe == NULL)
+		return -1;
+	r->ts.tv_sec = msec / 1000;
+	r->ts.tv_nsec = (msec % 1000) * 1000000;
+	sqe->opcode = IORING_OP_TIMEOUT;
+	sqe->fd = -1;
+	sqe->addr = (uintptr_t)&r->ts;
+	sqe->len = 1;
+	sqe->user_data = (uintptr_t)data;
+	return 0;
+}
+
+int uring_submit(uring_p r, unsigned int wait_nr){
+	unsigned int to_submit = r->sq_local_tail - *r->sq_tail;
+	int ret;
+
+	__atomic_store_n(r->sq_tail, r->sq_local_tail, __ATOMIC_RELEASE);
+	if(to_submit == 0 && wait_nr == 0)
+		return 0;
+	do {
+		ret = syscall(__NR_io_uring_enter, r->fd, to_submit, wait_nr,
+					wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+		to_submit = 0;
+	} while(ret < 0 && errno == EINTR && wait_nr > 0 &&
+			*r->cq_head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE));
+	return ret < 0 ? -1 : 0;
+}
+
+int uring_next(uring_p r, uring_event_t *ev){
+	unsigned int head = *r->cq_head;
+	struct io_uring_cqe *cqe;
+
+	if(head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+		return 0;
+	cqe = &r->cqes[head & *r->cq_mask];
+	ev->data = (void*)(uintptr_t)cqe->user_data;
+	ev->res = cqe->res;
+	ev->more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+	ev->bid = (cqe->flags & IORING_CQE_F_BUFFER) ?
+					(int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+	__atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+void destroy_uring(uring_p r){
+	munmap(r->sqes, r->sqes_size);
+	if(r->cq_ring != r->sq_ring)
+		munmap(r->cq_ring, r->cq_ring_size);
+	munmap(r->sq_ring, r->sq_ring_size);
+	close(r->fd);
+	if(r->buf_ring != NULL)
+		munmap(r->buf_ring, r->buf_ring_size);
+	free(r->bufs);
+	free(r);
+}
+
+#else
+
+/* Built without io_uring support, so every operation fails and callers use
+   their regular socket path instead. */
+
+uring_p create_uring(unsigned int entries){
+	(void)entries;
+	errno = ENOSYS;
+	return NULL;
+}
+
+int uring_provide_buffers(uring_p r, unsigned int count, unsigned int size){
+	(void)r; (void)count; (void)size;
+	return -1;
+}
+
+void* uring_buffer(uring_p r, int bid){
+	(void)r; (void)bid;
+	return NULL;
+}
+
+void uring_recycle_buffer(uring_p r, int bid){
+	(void)r; (void)bid;
+}
+
+int uring_recv_multishot(uring_p r, int fd, void *data){
+	(void)r; (void)fd; (void)data;
+	return -1;
+}
+
+int uring_probe_recv_multishot(uring_p r){
+	(void)r;
+	return 0;
+}
+
+int uring_reserve(uring_p r, unsigned int n){
+	(void)r; (void)n;
+	return -1;
+}
+
+int uring_send(uring_p r, int fd, void *buf, size_t len, int link, void *data){
+	(void)r; (void)fd; (void)buf; (void)len; (void)link; (void)data;
+	return -1;
+}
+
+void uring_end_chain(uring_p r){
+	(void)r;
+}
+
+int uring_write(uring_p r, int fd, void *buf, size_t len, off_t offset, void *data){
+	(void)r; (void)fd; (void)buf; (void)len; (void)offset; (void)data;
+	return -1;
+}
+
+int uring_poll(uring_p r, int fd, void *data){
+	(void)r; (void)fd; (void)data;
+	return -1;
+}
+
+int uring_poll_events(uring_p r, int fd, unsigned int events, void *data){
+	(void)r; (void)fd; (void)events; (void)data;
+	return -1;
+}
+
+int uring_timeout(uring_p r, long msec, void *data){
+	(void)r; (void)msec; (void)data;
+	return -1;
+}
+
+int uring_submit(uring_p r, unsigned int wait_nr){
+	(void)r; (void)wait_nr;
+	errno = ENOSYS;
+	return -1;
+}
+
+int uring_next(uring_p r, uring_event_t *ev){
+	(void)r; (void)ev;
+	return 0;
+}
+
+void destroy_uring(uring_p r){
+	(void)r;
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef __URING_H__
+#define __URING_H__
+
+/* A minimal io_uring wrapper built directly on the system calls. When the
+   tree is built without HAVE_IO_URING, or the kernel refuses to set up a
+   ring, create_uring() returns NULL and callers fall back to plain sockets. */
+
+#include <stdlib.h>
+#include <sys/types.h>
+
+struct uring;
+
+typedef struct uring * uring_p;
+
+/* A single completion. data is the pointer given when the request was
+   queued, res is the result (negative errno on failure), more is set if a
+   multishot request will produce further completions and bid is the index
+   of the provided buffer holding the data, or -1 if none was used. */
+typedef struct {
+	void *data;
+	int res;
+	int more;
+	int bid;
+} uring_event_t;
+
+/* Create a ring with room for at least entries submissions. Returns NULL if
+   io_uring is not available. It must be destroyed by destroy_uring(). */
+uring_p create_uring(unsigned int entries);
+
+/* Register count buffers of size bytes each as a provided buffer ring for
+   multishot receives. count must be a power of two. Returns 0 on success,
+   -1 if the kernel does not support buffer rings. */
+int uring_provide_buffers(uring_p r, unsigned int count, unsigned int size);
+
+/* Get the memory of provided buffer bid */
+void* uring_buffer(uring_p r, int bid);
+
+/* Hand provided buffer bid back to the kernel once its data is consumed */
+void uring_recycle_buffer(uring_p r, int bid);
+
+/* Queue a multishot receive on fd into the provided buffer ring */
+int uring_recv_multishot(uring_p r, int fd, void *data);
+
+/* Returns 1 if the kernel supports multishot receives, which came after
+   provided buffer rings (6.0 against 5.19), 0 if not. It runs one on a
+   socket pair, so call it after uring_provide_buffers() and before anything
+   else is queued. */
+int uring_probe_recv_multishot(uring_p r);
+
+/* Make sure n requests can be queued without the queue being flushed to
+   the kernel in between, flushing it now if it has to be. A linked chain
+   has to be reserved up front, or a flush could submit half of it with the
+   link pointing at whatever is queued next. Returns -1 if there is no room. */
+int uring_reserve(uring_p r, unsigned int n);
+
+/* Queue a send of len bytes from buf on fd. If link is set, the next queued
+   request will not start until this one completes. */
+int uring_send(uring_p r, int fd, void *buf, size_t len, int link, void *data);
+
+/* Clear the link on the last queued request, ending the chain there */
+void uring_end_chain(uring_p r);
+
+/* Queue a write of len bytes from buf to fd at offset */
+int uring_write(uring_p r, int fd, void *buf, size_t len, off_t offset, void *data);
+
+/* Queue a one-shot wait for fd to become readable */
+int uring_poll(uring_p r, int fd, void *data);
+
+/* Queue a one-shot wait for any of the poll events on fd. The completion's
+   res holds the events that occurred. */
+int uring_poll_events(uring_p r, int fd, unsigned int events, void *data);
+
+/* Queue a timer that completes after the given number of milliseconds */
+int uring_timeout(uring_p r, long msec, void *data);
+
+/* Submit all queued requests and wait until at least wait_nr completions
+   are available. Returns -1 and sets errno on failure. */
+int uring_submit(uring_p r, unsigned int wait_nr);
+
+/* Pop the next completion into ev. Returns 1 if there was one, 0 otherwise. */
+int uring_next(uring_p r, uring_event_t *ev);
+
+/* Tear down the ring and free all the memory associated with it */
+void destroy_uring(uring_p r);
+
+#endif
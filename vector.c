@@ -8,9 +8,29 @@ vector_p create_vector(){
 	vec->capacity = BASE_CAP;
 	vec->length = 0;
 	vec->destructor = free;
+	vec->pool = NULL;
 	return vec;
 }
 
+vector_p create_pool_vector(pool_p pool){
+	vector_p vec = create_vector();
+	vec->pool = pool;
+	return vec;
+}
+
+static void* item_alloc(vector_p vec, size_t n){
+	if(vec->pool != NULL)
+		return pool_get(vec->pool);
+	return malloc(n);
+}
+
+static void item_free(vector_p vec, void* item){
+	if(vec->pool != NULL)
+		pool_put(vec->pool, item);
+	else
+		vec->destructor(item);
+}
+
 vector_p subvector(vector_p vec, int start, int end){
 	vector_p subvec = create_vector();
 	int i;
@@ -34,7 +54,7 @@ void check_length(vector_p vec){
 
 void vector_add(vector_p vec, void* data, size_t n){
 	check_length(vec);
-	vec->data[vec->length] = malloc(n);
+	vec->data[vec->length] = item_alloc(vec, n);
 	vec->sizes[vec->length] = n;
 	memcpy(vec->data[vec->length], data, n);
 	vec->length++;
@@ -49,8 +69,8 @@ void* vector_get(vector_p vec, size_t i){
 int vector_set(vector_p vec, size_t i, void* data, size_t n){
 	if(i >= vec->length)
 		return -1;
-	vec->destructor(vec->data[i]);
-	vec->data[i] = malloc(n);
+	item_free(vec, vec->data[i]);
+	vec->data[i] = item_alloc(vec, n);
 	vec->sizes[i] = n;
 	memcpy(vec->data[i], data, n);
 	return 0;
@@ -67,7 +87,7 @@ int vector_insert(vector_p vec, size_t i, void* data, size_t n){
 		vec->data[x+1] = vec->data[x];
 		vec->sizes[x+1] = vec->sizes[x];
 	}
-	vec->data[i] = malloc(n);
+	vec->data[i] = item_alloc(vec, n);
 	vec->sizes[i] = n;
 	memcpy(vec->data[i], data, n);
 	vec->length++;
@@ -78,7 +98,7 @@ void vector_remove(vector_p vec, size_t i){
 	unsigned int x;
 	if(i >= vec->length)
 		return;
-	vec->destructor(vec->data[i]);
+	item_free(vec, vec->data[i]);
 	vec->length--;
 	for(x=i;x<vec->length;++x){
 		vec->data[x] = vec->data[x+1];
@@ -98,11 +118,16 @@ int vector_index(vector_p vec, void* data, size_t n){
 	return -1;
 }
 
-void destroy_vector(vector_p vec){
+void vector_clear(vector_p vec){
 	unsigned int i;
 	for(i=0;i<vec->length;i++){
-		vec->destructor(vec->data[i]);
+		item_free(vec, vec->data[i]);
 	}
+	vec->length = 0;
+}
+
+void destroy_vector(vector_p vec){
+	vector_clear(vec);
 	free(vec->data);
 	free(vec->sizes);
 	free(vec);
@@ -4,6 +4,7 @@
 /* A C implementation of a vector, or dynamically expanding array. */
 
 #include <stdlib.h>
+#include "pool.h"
 
 #define BASE_CAP 10
 #define EXPAND_RATIO 1.5
@@ -14,6 +15,7 @@ struct vector{
 	size_t length;
 	size_t capacity;
 	void (*destructor)(void*);
+	pool_p pool;
 };
 
 typedef struct vector * vector_p;
@@ -21,6 +23,10 @@ typedef struct vector * vector_p;
 /* Create a vector object. It must be eventually destroyed by a call to 
    destroy_vector to avoid memory leaks. */
 vector_p create_vector();
+/* Create a vector whose items are kept in objects from pool rather than
+   allocated one by one. Every item added must fit in an object of the
+   pool. The pool must outlive the vector. */
+vector_p create_pool_vector(pool_p pool);
 /* Create a new vector that is composed of the items in the old vector with
    indices in the range of [start,end) */
 vector_p subvector(vector_p vec, int start, int end);
@@ -38,6 +44,8 @@ int vector_insert(vector_p vec, size_t i, void* data, size_t n);
 int vector_index(vector_p vec, void* data, size_t n);
 /* Remove the item at index i of the vector and free its memory */
 void vector_remove(vector_p vec, size_t i);
+/* Remove every item from the vector, keeping its capacity */
+void vector_clear(vector_p vec);
 /* Check to make sure there is still room in the vector and expand it if 
    necessary. This function is not meant to be called directly. */
 void check_length(vector_p vec);